@@ -40,7 +40,7 @@ static void restore(void *arg)
 {
 	if (whichp(ALSACTL)) {
 		_d("Restoring sound settings ...");
-		run_interactive(ALSACTL " -g restore", "Restoring sound settings");
+		run_async(ALSACTL " -g restore", "Restoring sound settings", NULL, NULL);
 	}
 }
 
@@ -56,7 +56,7 @@ static void setup(void *arg)
 	makedir("/tmp/.ICE-unix", 01777);
 
 	if (whichp("restorecon"))
-		run("restorecon /tmp/.ICE-unix /tmp/.X11-unix");
+		run_async("restorecon /tmp/.ICE-unix /tmp/.X11-unix", NULL, NULL, NULL);
 
 	umask(022);
 }
@@ -27,7 +27,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <sys/socket.h>
+#include <sys/uio.h>		/* writev() */
 #include <sys/un.h>
 #include <lite/lite.h>
 #include <uev/uev.h>
@@ -42,6 +44,7 @@
 #include "private.h"
 #include "sig.h"
 #include "service.h"
+#include "svclog.h"
 #include "util.h"
 
 extern svc_t *wdog;
@@ -181,21 +184,87 @@ ev_t ev_list[] = {
 	{ NULL, NULL }
 };
 
+/*
+ * Send svc_t, with interned strings replaced by offsets into the blob
+ * of strings that follows, preceded by its length.  See svc_strings()
+ */
 static void send_svc(int sd, svc_t *svc)
 {
-	svc_t empty;
-	size_t len;
+	struct iovec iov[SVC_NUM_STRINGS + 2];
+	svc_t empty = { .pid = -1 }, copy;
+	char **str[SVC_NUM_STRINGS];
+	uint32_t len = 0;
+	ssize_t total;
+	int i;
 
-	if (!svc) {
-		empty.pid = -1;
+	if (!svc)
 		svc = &empty;
+
+	memcpy(&copy, svc, sizeof(copy));
+	svc_strings(&copy, str);
+	for (i = 0; i < SVC_NUM_STRINGS; i++) {
+		size_t sz = 0;
+
+		if (*str[i])
+			sz = i ? strlen(*str[i]) + 1 : svc_args_size(*str[i]);
+
+		iov[i + 2].iov_base = *str[i];
+		iov[i + 2].iov_len  = sz;
+		*str[i] = (char *)(uintptr_t)len;
+		len += sz;
 	}
 
-	len = write(sd, svc, sizeof(*svc));
-	if (len != sizeof(*svc))
+	/* Not valid outside PID 1 */
+	copy.rlimit   = NULL;
+	copy.conds    = NULL;
+	copy.log.ring = NULL;
+	if (svc != &empty)
+		copy.log.dropped = svclog_dropped(svc);
+
+	iov[0].iov_base = &copy;
+	iov[0].iov_len  = sizeof(copy);
+	iov[1].iov_base = &len;
+	iov[1].iov_len  = sizeof(len);
+
+	total = writev(sd, iov, NELEMS(iov));
+	if (total != (ssize_t)(sizeof(copy) + sizeof(len) + len))
 		_d("Failed sending svc_t to client");
 }
 
+/*
+ * Send recent output of svc, from the position in rq->runlevel, which is
+ * updated for the client to follow.  NACK if there is no such service,
+ * or its output is not captured.
+ */
+static void send_log(int sd, struct init_request *rq, svc_t *svc)
+{
+	static char buf[SVCLOG_RING_SIZE];
+	uint32_t pos = (uint32_t)rq->runlevel;
+	uint32_t len = 0;
+	struct iovec iov[3];
+	ssize_t num = -1;
+
+	if (svc)
+		num = svclog_tail(svc, &pos, buf, sizeof(buf));
+
+	if (num < 0) {
+		rq->cmd = INIT_CMD_NACK;
+	} else {
+		rq->cmd = INIT_CMD_ACK;
+		rq->runlevel = (int)pos;
+		len = num;
+	}
+
+	iov[0].iov_base = rq;
+	iov[0].iov_len  = sizeof(*rq);
+	iov[1].iov_base = &len;
+	iov[1].iov_len  = sizeof(len);
+	iov[2].iov_base = buf;
+	iov[2].iov_len  = len;
+
+	if (writev(sd, iov, NELEMS(iov)) != (ssize_t)(sizeof(*rq) + sizeof(len) + len))
+		_d("Failed sending log to client");
+}
 
 /*
  * In contrast to the SysV compat handling in plugins/initctl.c, when
@@ -305,6 +374,19 @@ static void api_cb(uev_t *w, void *arg, int events)
 			rq.sleeptime = prevlevel;
 			break;
 
+		case INIT_CMD_GET_RELOAD:
+			_d("get reload stats");
+			memset(rq.data, 0, sizeof(rq.data));
+			conf_reload_stats((struct init_reload *)rq.data);
+			break;
+
+		case INIT_CMD_GET_POOL:
+			_d("get pool stats");
+			memset(rq.data, 0, sizeof(rq.data));
+			svc_pool_stats((struct init_pool *)rq.data,
+				       sizeof(rq.data) / sizeof(struct init_pool) - 1);
+			break;
+
 		case INIT_CMD_ACK:
 			_d("Client failed reading ACK");
 			goto leave;
@@ -358,6 +440,12 @@ static void api_cb(uev_t *w, void *arg, int events)
 			send_svc(sd, do_find(rq.data, sizeof(rq.data)));
 			goto leave;
 
+		case INIT_CMD_SVC_LOG:
+			_d("svc log: %s", rq.data);
+			strterm(rq.data, sizeof(rq.data));
+			send_log(sd, &rq, do_find(rq.data, sizeof(rq.data)));
+			goto leave;
+
 		default:
 			_d("Unsupported cmd: %d", rq.cmd);
 			break;
@@ -22,6 +22,8 @@
  */
 
 #include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 
@@ -89,6 +91,63 @@ exit:
 	return result;
 }
 
+static int read_all(int sd, void *buf, size_t len)
+{
+	char *ptr = buf;
+
+	while (len > 0) {
+		ssize_t num;
+
+		num = read(sd, ptr, len);
+		if (num <= 0) {
+			if (num == -1 && errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		ptr += num;
+		len -= num;
+	}
+
+	return 0;
+}
+
+/*
+ * Read svc_t and its blob of strings from finit, see send_svc() in
+ * api.c, then update all string pointers to point into @blob, which
+ * is reallocated as needed.
+ */
+static int svc_read(int sd, svc_t *svc, char **blob)
+{
+	char **str[SVC_NUM_STRINGS], *ptr;
+	uint32_t len;
+	int i;
+
+	if (read_all(sd, svc, sizeof(*svc)) || read_all(sd, &len, sizeof(len)))
+		return -1;
+
+	ptr = realloc(*blob, len + 2);
+	if (!ptr)
+		return -1;
+	*blob = ptr;
+
+	if (read_all(sd, ptr, len))
+		return -1;
+	ptr[len] = ptr[len + 1] = 0;
+
+	svc->rlimit   = NULL;
+	svc->conds    = NULL;
+	svc->log.ring = NULL;
+	svc_strings(svc, str);
+	for (i = 0; i < SVC_NUM_STRINGS; i++) {
+		uintptr_t off = (uintptr_t)*str[i];
+
+		*str[i] = &ptr[off < len ? off : len];
+	}
+
+	return 0;
+}
+
 svc_t *client_svc_iterator(int first)
 {
 	int sd = -1;
@@ -96,6 +155,7 @@ svc_t *client_svc_iterator(int first)
 		.magic = INIT_MAGIC,
 		.cmd   = INIT_CMD_SVC_ITER,
 	};
+	static char *blob = NULL;
 	static svc_t svc;
 
 	sd = client_connect();
@@ -109,7 +169,7 @@ svc_t *client_svc_iterator(int first)
 
 	if (write(sd, &rq, sizeof(rq)) != sizeof(rq))
 		goto error;
-	if (read(sd, &svc, sizeof(svc)) != sizeof(svc))
+	if (svc_read(sd, &svc, &blob))
 		goto error;
 
 	client_disconnect();
@@ -132,6 +192,7 @@ svc_t *client_svc_find(const char *arg)
 		.magic = INIT_MAGIC,
 		.cmd   = INIT_CMD_SVC_FIND,
 	};
+	static char *blob = NULL;
 	static svc_t svc;
 
 	sd = client_connect();
@@ -141,7 +202,7 @@ svc_t *client_svc_find(const char *arg)
 	strlcpy(rq.data, arg, sizeof(rq.data));
 	if (write(sd, &rq, sizeof(rq)) != sizeof(rq))
 		goto error;
-	if (read(sd, &svc, sizeof(svc)) != sizeof(svc))
+	if (svc_read(sd, &svc, &blob))
 		goto error;
 
 	client_disconnect();
@@ -157,6 +218,56 @@ error:
 	return NULL;
 }
 
+/*
+ * Recent output of service @arg, from @pos, which is updated to follow
+ * the output with another call.  The returned buffer, with @len bytes,
+ * is valid until the next call.  NULL if the service is not found, or
+ * has no captured output.
+ */
+char *client_svc_log(const char *arg, uint32_t *pos, size_t *len)
+{
+	struct init_request rq = {
+		.magic    = INIT_MAGIC,
+		.cmd      = INIT_CMD_SVC_LOG,
+		.runlevel = (int)*pos,
+	};
+	static char *buf = NULL;
+	uint32_t num;
+	char *ptr;
+
+	if (client_connect() == -1)
+		return NULL;
+
+	strlcpy(rq.data, arg, sizeof(rq.data));
+	if (write(sd, &rq, sizeof(rq)) != sizeof(rq))
+		goto error;
+	if (read_all(sd, &rq, sizeof(rq)) || read_all(sd, &num, sizeof(num)))
+		goto error;
+
+	ptr = realloc(buf, num + 1);
+	if (!ptr)
+		goto error;
+	buf = ptr;
+
+	if (read_all(sd, buf, num))
+		goto error;
+	buf[num] = 0;
+
+	client_disconnect();
+	if (rq.cmd != INIT_CMD_ACK)
+		return NULL;
+
+	*pos = (uint32_t)rq.runlevel;
+	*len = num;
+
+	return buf;
+error:
+	client_disconnect();
+	perror("Failed communicating with finit");
+
+	return NULL;
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
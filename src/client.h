@@ -24,6 +24,7 @@
 #ifndef FINIT_CLIENT_H_
 #define FINIT_CLIENT_H_
 
+#include <stdint.h>
 #include "finit.h"
 #include "svc.h"
 
@@ -33,5 +34,6 @@ int    client_disconnect   (void);
 int    client_send         (struct init_request *rq, ssize_t len);
 svc_t *client_svc_iterator (int first);
 svc_t *client_svc_find     (const char *arg);
+char  *client_svc_log      (const char *arg, uint32_t *pos, size_t *len);
 
 #endif /* FINIT_CLIENT_H_ */
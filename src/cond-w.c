@@ -50,17 +50,25 @@ static int cond_set_gen(const char *file, unsigned int gen)
 	return (ret > 0) ? 0 : ret;
 }
 
+/* Write-through of conditions remaining on after a reconf */
+static void cond_rebase(const char *name, unsigned int gen)
+{
+	cond_set_gen(cond_path(name), gen);
+}
+
 static void cond_bump_reconf(void)
 {
 	unsigned int rgen;
 
 	/*
 	 * If %COND_RECONF does not exist, cond_get_gen() returns 0
-	 * meaning that rgen++ is always what we want.
+	 * meaning that rgen++ is always what we want.  Once the store
+	 * is active this is served from memory.
 	 */
 	rgen = cond_get_gen(COND_RECONF);
 	rgen++;
 
+	cond_store_reconf(rgen, cond_rebase);
 	cond_set_gen(COND_RECONF, rgen);
 }
 
@@ -87,6 +95,7 @@ int cond_set_path(const char *path, enum cond_state new)
 {
 	enum cond_state old;
 	unsigned int rgen;
+	const char *nm;
 
 	_d("%s", path);
 
@@ -96,16 +105,29 @@ int cond_set_path(const char *path, enum cond_state new)
 		return -1;
 	}
 
-	old = cond_get_path(path);
+	nm = cond_name(path);
+	if (!nm) {
+		_e("Invalid path '%s' for condition", path);
+		return 0;
+	}
+
+	old = cond_get(nm);
+	if (new == old)
+		return 0;
 
 	switch (new) {
 	case COND_ON:
+		/* Still write through to disk, for initctl and scripts */
+		if (cond_store_set(nm, rgen, 0) && cond_store_active())
+			_pe("Failed storing condition '%s'", nm);
 		if (cond_checkpath(path))
-		    return 0;
-		cond_set_gen(path, rgen);
+			break;
+		if (cond_set_gen(path, rgen))
+			_pe("Failed writing condition '%s'", path);
 		break;
 
 	case COND_OFF:
+		cond_store_set(nm, 0, 0);
 		if (unlink(path) && errno != ENOENT)
 			_pe("Failed removing condition '%s'", path);
 		break;
@@ -115,7 +137,7 @@ int cond_set_path(const char *path, enum cond_state new)
 		return 0;
 	}
 
-	return new != old;
+	return 1;
 }
 
 /* Has condition in configuration and cond is allowed? */
@@ -137,17 +159,34 @@ static int svc_has_cond(svc_t *svc)
 	return 0;
 }
 
+/*
+ * Queue services affected by a condition change, or all services with
+ * conditions when @name is %NULL, for service_worker() to step.
+ */
 static void cond_update(const char *name)
 {
 	svc_t *svc, *iter = NULL;
+	struct cond_ref *ref = NULL;
 
 	_d("%s", name);
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
-		if (!svc_has_cond(svc) || !cond_affects(name, svc->cond))
+	if (!name) {
+		for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+			if (!svc_has_cond(svc))
+				continue;
+
+			_d("nil: match <%s> %s(%s)", svc->cond, svc->desc, svc->cmd);
+			service_enqueue(svc);
+		}
+		return;
+	}
+
+	/* Only services depending on this condition */
+	for (svc = cond_dep_iterator(&ref, name, 1); svc; svc = cond_dep_iterator(&ref, name, 0)) {
+		if (!svc_has_cond(svc))
 			continue;
 
-		_d("%s: match <%s> %s(%s)", name ?: "nil", svc->cond, svc->desc, svc->cmd);
-		service_step(svc);
+		_d("%s: match <%s> %s(%s)", name, svc->cond, svc->desc, svc->cmd);
+		service_enqueue(svc);
 	}
 }
 
@@ -173,10 +212,10 @@ void cond_set_oneshot(const char *name)
 	path = cond_path(name);
 	_d("%s => %s", name, path);
 
-	if (cond_checkpath(path))
-		return;
+	cond_store_set(name, 0, 1);
+	if (!cond_checkpath(path))
+		symlink(COND_RECONF, path);
 
-	symlink(COND_RECONF, path);
 	cond_update(name);
 }
 
@@ -192,10 +231,25 @@ void cond_clear(const char *name)
 	cond_update(name);
 }
 
+/*
+ * Only the conditions of services changed by the reload, and of their
+ * dependents, are put in flux.  Everything else stays on, so unrelated
+ * services are not stopped waiting for their conditions to reassert.
+ */
 void cond_reload(void)
 {
+	svc_t *svc, *iter = NULL;
+	char cond[MAX_COND_LEN];
+
 	_d("");
 
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		if (!svc_is_changed(svc))
+			continue;
+
+		cond_store_flux(mkcond(cond, sizeof(cond), svc->cmd));
+	}
+
 	cond_bump_reconf();
 	cond_update(NULL);
 }
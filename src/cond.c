@@ -29,6 +29,416 @@
 #include "pid.h"
 #include "service.h"
 
+#define COND_HASH_SIZE 128
+#define COND_BUCKET(h) ((h) & (COND_HASH_SIZE - 1))
+
+/*
+ * In-memory condition store, authoritative inside finit once cond_init()
+ * has activated it.  The files in COND_PATH are written through by the
+ * cond-w.c setters, for initctl which never activates the store and so
+ * keeps reading the files.
+ *
+ * Each condition also holds the list of services that depend on it, so
+ * a change only needs to step those services.  Each service in turn has
+ * an array of the same references, see cond_dep_add(), which is used to
+ * evaluate its conditions.  An entry is kept while the condition is set
+ * or has any dependents.
+ */
+struct cond_ref {
+	TAILQ_ENTRY(cond_ref) link;
+	svc_t            *svc;
+	struct cond      *cond;
+};
+
+struct cond {
+	TAILQ_ENTRY(cond) link;
+	TAILQ_HEAD(, cond_ref) deps;
+	unsigned int      gen;
+	int               oneshot;	/* Symlink to reconf, always on */
+	int               flux;		/* Left behind by next reconf */
+	char              name[0];
+};
+
+static TAILQ_HEAD(cond_head, cond) cond_tbl[COND_HASH_SIZE];
+static unsigned int cond_rgen = 0;	/* Zero means store is inactive */
+
+static unsigned int strhash(const char *str)
+{
+	unsigned int hash = 5381;
+
+	while (*str)
+		hash = ((hash << 5) + hash) + (unsigned char)*str++;
+
+	return hash;
+}
+
+static void cond_tbl_init(void)
+{
+	static int done = 0;
+	int i;
+
+	if (done)
+		return;
+
+	for (i = 0; i < COND_HASH_SIZE; i++)
+		TAILQ_INIT(&cond_tbl[i]);
+	done = 1;
+}
+
+static struct cond *cond_find(const char *name)
+{
+	struct cond *c;
+
+	cond_tbl_init();
+	TAILQ_FOREACH(c, &cond_tbl[COND_BUCKET(strhash(name))], link) {
+		if (!strcmp(c->name, name))
+			return c;
+	}
+
+	return NULL;
+}
+
+/* Find or create condition entry */
+static struct cond *cond_intern(const char *name)
+{
+	struct cond *c;
+	size_t len;
+
+	c = cond_find(name);
+	if (c)
+		return c;
+
+	len = strlen(name) + 1;
+	c = malloc(sizeof(*c) + len);
+	if (!c)
+		return NULL;
+
+	memcpy(c->name, name, len);
+	TAILQ_INIT(&c->deps);
+	c->gen = 0;
+	c->oneshot = 0;
+	c->flux = 0;
+	TAILQ_INSERT_TAIL(&cond_tbl[COND_BUCKET(strhash(name))], c, link);
+
+	return c;
+}
+
+/* Drop condition entry if it is neither set nor depended on */
+static void cond_release(struct cond *c)
+{
+	if (c->gen || c->oneshot || !TAILQ_EMPTY(&c->deps))
+		return;
+
+	TAILQ_REMOVE(&cond_tbl[COND_BUCKET(strhash(c->name))], c, link);
+	free(c);
+}
+
+static enum cond_state cond_eval(unsigned int rgen, unsigned int cgen)
+{
+	if (!rgen || !cgen)
+		return COND_OFF;
+
+	return (cgen == rgen) ? COND_ON : COND_FLUX;
+}
+
+/**
+ * cond_store_active - Check if in-memory condition store is in use
+ *
+ * Returns:
+ * Current reconf generation, or zero if conditions are read from disk.
+ */
+unsigned int cond_store_active(void)
+{
+	return cond_rgen;
+}
+
+/**
+ * cond_store_reconf - Activate store or set new reconf generation
+ * @rgen: New reconf generation, must be non-zero
+ * @cb:   Called for each condition moved to @rgen, for write-through
+ *
+ * Unlike the files on disk, where a new reconf generation puts all
+ * conditions in flux, only the conditions marked by cond_store_flux()
+ * are left behind.  All other set conditions follow @rgen, i.e. remain
+ * on, and @cb is called for each of them to update the file on disk.
+ */
+void cond_store_reconf(unsigned int rgen, void (*cb)(const char *name, unsigned int gen))
+{
+	struct cond *c;
+	int i;
+
+	cond_tbl_init();
+	for (i = 0; cond_rgen && i < COND_HASH_SIZE; i++) {
+		TAILQ_FOREACH(c, &cond_tbl[i], link) {
+			if (c->flux) {
+				c->flux = 0;
+				continue;
+			}
+
+			if (!c->gen || c->oneshot)
+				continue;
+
+			c->gen = rgen;
+			if (cb)
+				cb(c->name, rgen);
+		}
+	}
+
+	cond_rgen = rgen;
+}
+
+static void cond_flux_mark(struct cond *c)
+{
+	char name[MAX_COND_LEN];
+	struct cond_ref *ref;
+
+	if (c->flux)
+		return;
+
+	c->flux = 1;
+	TAILQ_FOREACH(ref, &c->deps, link) {
+		struct cond *dep;
+
+		dep = cond_find(mkcond(name, sizeof(name), ref->svc->cmd));
+		if (dep)
+			cond_flux_mark(dep);
+	}
+}
+
+/**
+ * cond_store_flux - Put condition in flux at next reconf
+ * @name: Condition name, relative to COND_PATH
+ *
+ * Marks condition @name, and transitively the svc/ conditions of all
+ * services depending on it, to be put in flux by cond_store_reconf().
+ */
+void cond_store_flux(const char *name)
+{
+	struct cond *c;
+
+	c = cond_find(name);
+	if (c)
+		cond_flux_mark(c);
+}
+
+/**
+ * cond_store_set - Update condition in in-memory store
+ * @name:    Condition name, relative to COND_PATH
+ * @gen:     New generation, zero to remove the condition
+ * @oneshot: Condition follows the reconf generation, like a symlink
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero if the store is inactive or out of memory.
+ */
+int cond_store_set(const char *name, unsigned int gen, int oneshot)
+{
+	struct cond *c;
+
+	if (!cond_rgen)
+		return 1;
+
+	if (!gen && !oneshot) {
+		c = cond_find(name);
+		if (c) {
+			c->gen = 0;
+			c->oneshot = 0;
+			cond_release(c);
+		}
+		return 0;
+	}
+
+	c = cond_intern(name);
+	if (!c)
+		return 1;
+
+	c->gen = gen;
+	if (oneshot)
+		c->oneshot = 1;
+
+	return 0;
+}
+
+/* Link @svc to condition @c, unless already done */
+static int cond_ref_add(svc_t *svc, struct cond *c)
+{
+	struct cond_ref *ref, **refs;
+	int i;
+
+	for (i = 0; i < svc->num_conds; i++) {
+		if (svc->conds[i]->cond == c)
+			return 0;
+	}
+
+	refs = realloc(svc->conds, (svc->num_conds + 1) * sizeof(*refs));
+	if (!refs)
+		return 1;
+	svc->conds = refs;
+
+	ref = malloc(sizeof(*ref));
+	if (!ref)
+		return 1;
+
+	ref->svc  = svc;
+	ref->cond = c;
+	TAILQ_INSERT_TAIL(&c->deps, ref, link);
+	svc->conds[svc->num_conds++] = ref;
+
+	return 0;
+}
+
+/**
+ * cond_dep_add - Compile conditions of a service
+ * @svc:   Pointer to &svc_t
+ * @names: Comma separated list of conditions, no length limit
+ *
+ * Any previous conditions of @svc are dropped.  Each condition is then
+ * interned in the condition table, so cond_get_svc() can evaluate them
+ * without any string operations, and @svc is registered as dependent
+ * on it, so cond_dep_iterator() can find it.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on memory allocation error.
+ */
+int cond_dep_add(svc_t *svc, const char *names)
+{
+	char *conds, *cond, *saveptr;
+	int rc = 0;
+
+	cond_dep_del(svc);
+	if (!names || !names[0])
+		return 0;
+
+	conds = strdup(names);
+	if (!conds)
+		return 1;
+
+	for (cond = strtok_r(conds, ",", &saveptr); cond; cond = strtok_r(NULL, ",", &saveptr)) {
+		struct cond *c;
+
+		c = cond_intern(cond);
+		if (!c || cond_ref_add(svc, c)) {
+			_pe("Failed tracking condition %s for %s", cond, svc->cmd);
+			if (c)
+				cond_release(c);
+			rc = 1;
+		}
+	}
+	free(conds);
+
+	return rc;
+}
+
+/**
+ * cond_dep_equal - Check if conditions of a service are unchanged
+ * @svc:   Pointer to &svc_t
+ * @names: Comma separated list of conditions
+ *
+ * Returns:
+ * %TRUE(1) if @names is the same list as compiled by cond_dep_add().
+ */
+int cond_dep_equal(svc_t *svc, const char *names)
+{
+	int i = 0;
+
+	while (names && *names) {
+		size_t len = strcspn(names, ",");
+
+		if (len) {
+			const char *name;
+
+			if (i >= svc->num_conds)
+				return 0;
+
+			name = svc->conds[i++]->cond->name;
+			if (strlen(name) != len || strncmp(name, names, len))
+				return 0;
+		}
+
+		names += len;
+		if (*names == ',')
+			names++;
+	}
+
+	return i == svc->num_conds;
+}
+
+/**
+ * cond_dep_copy - Copy compiled conditions from one service to another
+ * @dst: Pointer to &svc_t, e.g. an inetd connection
+ * @src: Pointer to &svc_t to copy conditions from
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on memory allocation error.
+ */
+int cond_dep_copy(svc_t *dst, svc_t *src)
+{
+	int i;
+
+	cond_dep_del(dst);
+	for (i = 0; i < src->num_conds; i++) {
+		if (cond_ref_add(dst, src->conds[i]->cond))
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * cond_dep_del - Drop all compiled conditions of a service
+ * @svc: Pointer to &svc_t
+ */
+void cond_dep_del(svc_t *svc)
+{
+	int i;
+
+	for (i = 0; i < svc->num_conds; i++) {
+		struct cond_ref *ref = svc->conds[i];
+
+		TAILQ_REMOVE(&ref->cond->deps, ref, link);
+		cond_release(ref->cond);
+		free(ref);
+	}
+
+	free(svc->conds);
+	svc->conds = NULL;
+	svc->num_conds = 0;
+}
+
+/**
+ * cond_dep_iterator - Iterate over services depending on a condition
+ * @iter:  Iterator, must be a valid pointer
+ * @name:  Condition name, only used when @first is set
+ * @first: If set, get first &svc_t, otherwise get next
+ *
+ * Like svc_iterator() the next entry is prefetched, so the current
+ * service may safely be unregistered while iterating.
+ *
+ * Returns:
+ * An &svc_t pointer, or %NULL when no more entries can be found.
+ */
+svc_t *cond_dep_iterator(struct cond_ref **iter, const char *name, int first)
+{
+	struct cond_ref *ref;
+
+	if (first) {
+		struct cond *c;
+
+		c = cond_find(name);
+		if (!c)
+			return NULL;
+
+		ref = TAILQ_FIRST(&c->deps);
+	} else
+		ref = *iter;
+
+	if (!ref)
+		return NULL;
+
+	*iter = TAILQ_NEXT(ref, link);
+
+	return ref->svc;
+}
+
 
 char *mkcond(char *buf, size_t len, char *nm)
 {
@@ -57,6 +467,39 @@ const char *cond_path(const char *name)
 	return pid_runpath(tmp, path, sizeof(path));
 }
 
+/**
+ * cond_name - Reverse of cond_path()
+ * @path: Path to condition, in /run or /var/run
+ *
+ * Returns:
+ * Pointer into @path where the condition name starts, or %NULL if
+ * @path is not a condition.
+ */
+const char *cond_name(const char *path)
+{
+	const char *nm;
+
+	nm = strstr(path, COND_DIR "/");
+	if (!nm)
+		return NULL;
+
+	return nm + sizeof(COND_DIR);
+}
+
+static unsigned int cond_store_gen(const char *name)
+{
+	struct cond *c;
+
+	if (!strcmp(name, "reconf"))
+		return cond_rgen;
+
+	c = cond_find(name);
+	if (!c)
+		return 0;
+
+	return c->oneshot ? cond_rgen : c->gen;
+}
+
 unsigned int cond_get_gen(const char *file)
 {
 	char *ptr, path[256];
@@ -64,6 +507,13 @@ unsigned int cond_get_gen(const char *file)
 	FILE *fp;
 	int ret;
 
+	if (cond_rgen) {
+		const char *nm;
+
+		nm = cond_name(file);
+		return nm ? cond_store_gen(nm) : 0;
+	}
+
 	/* /var/run --> /run symlink may not exist (yet) */
 	ptr = pid_runpath(file, path, sizeof(path));
 
@@ -79,55 +529,65 @@ unsigned int cond_get_gen(const char *file)
 
 enum cond_state cond_get_path(const char *path)
 {
-	int cgen, rgen;
+	unsigned int rgen;
 
 	rgen = cond_get_gen(COND_RECONF);
 	if (!rgen)
 		return COND_OFF;
 
-	cgen = cond_get_gen(path);
-	if (!cgen)
-		return COND_OFF;
-
-	return (cgen == rgen) ? COND_ON : COND_FLUX;
+	return cond_eval(rgen, cond_get_gen(path));
 }
 
 enum cond_state cond_get(const char *name)
 {
+	if (cond_rgen)
+		return cond_eval(cond_rgen, cond_store_gen(name));
+
 	return cond_get_path(cond_path(name));
 }
 
 enum cond_state cond_get_agg(const char *names)
 {
-	char *cond;
+	char *conds, *cond, *saveptr;
 	enum cond_state s = COND_ON;
-	static char conds[MAX_COND_LEN];
 
 	if (!names)
 		return COND_ON;
 
-	strlcpy(conds, names, sizeof(conds));
-	for (cond = strtok(conds, ","); s && cond; cond = strtok(NULL, ","))
+	conds = strdup(names);
+	if (!conds)
+		return COND_OFF;
+
+	for (cond = strtok_r(conds, ",", &saveptr); s && cond; cond = strtok_r(NULL, ",", &saveptr))
 		s = min(s, cond_get(cond));
+	free(conds);
 
 	return s;
 }
 
-int cond_affects(const char *name, const char *names)
+/**
+ * cond_get_svc - Aggregate state of all conditions of a service
+ * @svc: Pointer to &svc_t, conditions compiled by cond_dep_add()
+ *
+ * Returns:
+ * The lowest state of any condition, %COND_ON if @svc has none.
+ */
+enum cond_state cond_get_svc(svc_t *svc)
 {
-	char *cond;
-	static char conds[MAX_COND_LEN];
+	enum cond_state s = COND_ON;
+	int i;
 
-	if (!name || !names)
-		return 0;
+	/* Before cond_init(), e.g. at bootstrap, no generation in memory */
+	if (!cond_rgen)
+		return cond_get_agg(svc->cond);
 
-	strlcpy(conds, names, sizeof(conds));
-	for (cond = strtok(conds, ","); cond; cond = strtok(NULL, ",")) {
-		if (!strcmp(cond, name))
-			return 1;
+	for (i = 0; s && i < svc->num_conds; i++) {
+		struct cond *c = svc->conds[i]->cond;
+
+		s = min(s, cond_eval(cond_rgen, c->oneshot ? cond_rgen : c->gen));
 	}
 
-	return 0;
+	return s;
 }
 
 /**
@@ -7,6 +7,9 @@
 #define COND_PATH     _PATH_VARRUN COND_DIR
 #define COND_RECONF   COND_PATH "/reconf"
 
+struct svc;
+struct cond_ref;
+
 typedef enum cond_state {
 	COND_OFF = 0,
 	COND_FLUX,
@@ -16,11 +19,23 @@ typedef enum cond_state {
 char           *mkcond       (char *buf, size_t len, char *nm);
 const char     *condstr      (enum cond_state s);
 const char     *cond_path    (const char *name);
+const char     *cond_name    (const char *path);
 unsigned int    cond_get_gen (const char *path);
 enum cond_state cond_get_path(const char *path);
 enum cond_state cond_get     (const char *name);
 enum cond_state cond_get_agg (const char *names);
-int             cond_affects (const char *name, const char *names);
+enum cond_state cond_get_svc (struct svc *svc);
+
+unsigned int cond_store_active(void);
+void         cond_store_reconf(unsigned int rgen, void (*cb)(const char *name, unsigned int gen));
+void         cond_store_flux  (const char *name);
+int          cond_store_set   (const char *name, unsigned int gen, int oneshot);
+
+int         cond_dep_add      (struct svc *svc, const char *names);
+int         cond_dep_equal    (struct svc *svc, const char *names);
+int         cond_dep_copy     (struct svc *dst, struct svc *src);
+void        cond_dep_del      (struct svc *svc);
+struct svc *cond_dep_iterator (struct cond_ref **iter, const char *name, int first);
 
 int  cond_set_path    (const char *path, enum cond_state new);
 void cond_set         (const char *name);
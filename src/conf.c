@@ -31,12 +31,15 @@
 #include <lite/queue.h>		/* BSD sys/queue.h API */
 #include <sys/time.h>
 #include <glob.h>
+#include <time.h>
 
 #include "finit.h"
 #include "cond.h"
+#include "conf.h"
 #include "service.h"
 #include "tty.h"
 #include "helpers.h"
+#include "schedule.h"
 #include "util.h"
 
 #define BOOTSTRAP (runlevel == 0)
@@ -46,6 +49,9 @@
 int logfile_size_max = 200000;	/* 200 kB */
 int logfile_count_max = 5;
 
+int reload_settle_ms = 250;
+int reload_latency_ms = 2000;
+
 struct rlimit global_rlimit[RLIMIT_NLIMITS];
 
 struct conf_change {
@@ -56,8 +62,20 @@ struct conf_change {
 static uev_t w1, w2, w3, w4;
 static TAILQ_HEAD(head, conf_change) conf_change_list = TAILQ_HEAD_INITIALIZER(conf_change_list);
 
+/* Coalescing of .conf changes, see conf_cb() */
+static struct timespec first_change;
+static int num_pending;		/* Events since last reload */
+static int num_coalesced;	/* Events handled by last reload */
+static int num_reloads;
+
 static int parse_conf(char *file);
 static void drop_changes(void);
+static void conf_settle(void);
+static void settle_cb(void *arg);
+
+static struct wq settle = {
+	.cb = settle_cb,
+};
 
 void conf_parse_cmdline(void)
 {
@@ -92,6 +110,9 @@ void conf_parse_cmdline(void)
 
 		if (string_compare(tok, "splash"))
 			splash = 1;
+
+		if (string_match(tok, "finit.fsck_max="))
+			fsck_max = atoi(&tok[15]);
 	}
 	fclose(fp);
 
@@ -127,7 +148,7 @@ static int kmod_exists(char *mod)
 static void kmod_load(char *line)
 {
 	char *mod;
-	char cmd[CMD_SIZE];
+	char cmd[CMD_SIZE], buf[LINE_SIZE];
 
 	if (runlevel != 0)
 		return;
@@ -139,7 +160,8 @@ static void kmod_load(char *line)
 	strcpy(cmd, "modprobe ");
 	strlcat(cmd, mod, sizeof(cmd));
 
-	run_interactive(cmd, "Loading kernel module %s", mod);
+	snprintf(buf, sizeof(buf), "Loading kernel module %s", mod);
+	run_async(cmd, buf, NULL, NULL);
 }
 
 /* Convert optional "[!123456789S]" string into a bitmask */
@@ -178,22 +200,30 @@ int conf_parse_runlevels(char *runlevels)
 	return bitmask;
 }
 
-void conf_parse_cond(svc_t *svc, char *cond)
+/*
+ * Returns non-zero if the conditions of @svc changed, used on reload
+ */
+int conf_parse_cond(svc_t *svc, char *cond)
 {
 	size_t i = 0;
 	char *ptr;
+	int changed;
 
 	if (!svc) {
 		_e("Invalid service pointer");
-		return;
+		return 0;
 	}
 
 	/* By default we assume UNIX daemons support SIGHUP */
 	if (svc_is_daemon(svc))
 		svc->sighup = 1;
 
-	if (!cond)
-		return;
+	if (!cond) {
+		changed = svc->num_conds > 0;
+		cond_dep_del(svc);
+		svc_strset(&svc->cond, NULL);
+		return changed;
+	}
 
 	/* First character must be '!' if SIGHUP is not supported. */
 	ptr = cond;
@@ -206,12 +236,16 @@ void conf_parse_cond(svc_t *svc, char *cond)
 		i++;
 	ptr[i] = 0;
 
-	if (i >= sizeof(svc->cond)) {
-		logit(LOG_WARNING, "Too long event list in declaration of %s: %s", svc->cmd, ptr);
-		return;
-	}
+	if (cond_dep_equal(svc, ptr))
+		return 0;
+
+	if (cond_dep_add(svc, ptr))
+		logit(LOG_WARNING, "Failed compiling conditions of %s: %s", svc->cmd, ptr);
 
-	strlcpy(svc->cond, ptr, sizeof(svc->cond));
+	/* Only used for display */
+	svc_strset(&svc->cond, ptr);
+
+	return 1;
 }
 
 struct rlimit_name {
@@ -345,7 +379,7 @@ error:
 static void parse_static(char *line)
 {
 	char *x;
-	char cmd[CMD_SIZE];
+	char cmd[CMD_SIZE], desc[LINE_SIZE];
 
 	if (BOOTSTRAP && (MATCH_CMD(line, "host ", x) || MATCH_CMD(line, "hostname ", x))) {
 		if (hostname) free(hostname);
@@ -358,7 +392,8 @@ static void parse_static(char *line)
 
 		strcpy(cmd, "mknod ");
 		strlcat(cmd, dev, sizeof(cmd));
-		run_interactive(cmd, "Creating device node %s", dev);
+		snprintf(desc, sizeof(desc), "Creating device node %s", dev);
+		run_async(cmd, desc, NULL, NULL);
 
 		return;
 	}
@@ -408,6 +443,44 @@ static void parse_static(char *line)
 			logfile_count_max = count;
 	}
 
+	if (MATCH_CMD(line, "reload-delay ", x)) {
+		const char *err = NULL;
+		char *tok, *val;
+
+		tok = strtok(x, ":= ");
+		while (tok) {
+			int *ms, max, num;
+
+			val = strtok(NULL, ":= ");
+			if (!val)
+				break;
+
+			if (!strcmp(tok, "settle")) {
+				ms  = &reload_settle_ms;
+				max = 60000;
+			} else if (!strcmp(tok, "max")) {
+				ms  = &reload_latency_ms;
+				max = 600000;
+			} else {
+				logit(LOG_WARNING, "reload-delay: unknown option %s", tok);
+				goto next;
+			}
+
+			num = strtonum(val, 0, max, &err);
+			if (err) {
+				logit(LOG_WARNING, "reload-delay: invalid %s value %s", tok, val);
+				err = NULL;
+			} else
+				*ms = num;
+		next:
+			tok = strtok(NULL, ":= ");
+		}
+
+		if (reload_latency_ms < reload_settle_ms)
+			reload_latency_ms = reload_settle_ms;
+		return;
+	}
+
 	if (MATCH_CMD(line, "shutdown ", x)) {
 		if (sdown) free(sdown);
 		sdown = strdup(strip_line(x));
@@ -563,6 +636,9 @@ static int parse_conf(char *file)
 
 	fclose(fp);
 
+	/* Modules and device nodes are loaded in parallel, wait for them */
+	run_wait();
+
 	/* Set global limits */
 	for (int i = 0; i < RLIMIT_NLIMITS; i++) {
 		if (setrlimit(i, &global_rlimit[i]) == -1)
@@ -573,14 +649,93 @@ static int parse_conf(char *file)
 	return 0;
 }
 
+/* Check that @path is a .conf file, beyond any symlinks */
+static int is_conf(char *path)
+{
+	size_t len;
+	struct stat st;
+
+	/* Check that it's an actual file ... beyond any symlinks */
+	if (lstat(path, &st)) {
+		_d("Skipping %s, cannot access: %s", path, strerror(errno));
+		return 0;
+	}
+
+	/* Skip directories */
+	if (S_ISDIR(st.st_mode)) {
+		_d("Skipping directory %s", path);
+		return 0;
+	}
+
+	/* Check for dangling symlinks */
+	if (S_ISLNK(st.st_mode)) {
+		char *rp;
+
+		rp = realpath(path, NULL);
+		if (!rp) {
+			logit(LOG_WARNING, "Skipping %s, dangling symlink: %s", path, strerror(errno));
+			return 0;
+		}
+
+		free(rp);
+	}
+
+	/* Check that file ends with '.conf' */
+	len = strlen(path);
+	if (len < 6 || strcmp(&path[len - 5], ".conf")) {
+		_d("Skipping %s, not a valid .conf ... ", path);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Re-parse only the *.conf in /etc/finit.d/ recorded in conf_change_list.
+ * All services and TTYs registered from a changed file are first marked
+ * for removal, so any no longer declared in it, or the file itself has
+ * been removed, are swept as on a full reload.
+ */
+static void reload_changes(void)
+{
+	struct conf_change *node;
+
+	TAILQ_FOREACH(node, &conf_change_list, link) {
+		_d("Marking services and TTYs from %s ...", node->name);
+		svc_mark_file(node->name);
+		tty_mark_file(node->name);
+	}
+
+	TAILQ_FOREACH(node, &conf_change_list, link) {
+		char path[256];
+
+		snprintf(path, sizeof(path), "%s/%s", FINIT_RCSD, node->name);
+		if (fexist(path) && is_conf(path))
+			parse_conf_dynamic(path);
+
+		snprintf(path, sizeof(path), "%s/enabled/%s", FINIT_RCSD, node->name);
+		if (fexist(path) && is_conf(path))
+			parse_conf_dynamic(path);
+	}
+}
+
 /*
  * Reload /etc/finit.conf and all *.conf in /etc/finit.d/
+ *
+ * Only the files changed since last reload are re-parsed, unless @full
+ * is set, nothing has been recorded, or /etc/finit.conf itself changed.
+ * In those cases all services are marked and swept.
  */
-int conf_reload(void)
+int conf_reload(int full)
 {
 	size_t i;
 	glob_t gl;
 
+	if (!full && !rescue && conf_any_change() && !conf_changed(FINIT_CONF)) {
+		reload_changes();
+		goto done;
+	}
+
 	/* Mark and sweep */
 	svc_mark_dynamic();
 	tty_mark();
@@ -607,40 +762,9 @@ int conf_reload(void)
 
 	for (i = 0; i < gl.gl_pathc; i++) {
 		char *path = gl.gl_pathv[i];
-		size_t len;
-		struct stat st;
-
-		/* Check that it's an actual file ... beyond any symlinks */
-		if (lstat(path, &st)) {
-			_d("Skipping %s, cannot access: %s", path, strerror(errno));
-			continue;
-		}
-
-		/* Skip directories */
-		if (S_ISDIR(st.st_mode)) {
-			_d("Skipping directory %s", path);
-			continue;
-		}
-
-		/* Check for dangling symlinks */
-		if (S_ISLNK(st.st_mode)) {
-			char *rp;
-
-			rp = realpath(path, NULL);
-			if (!rp) {
-				logit(LOG_WARNING, "Skipping %s, dangling symlink: %s", path, strerror(errno));
-				continue;
-			}
-
-			free(rp);
-		}
 
-		/* Check that file ends with '.conf' */
-		len = strlen(path);
-		if (len < 6 || strcmp(&path[len - 5], ".conf")) {
-			_d("Skipping %s, not a valid .conf ... ", path);
+		if (!is_conf(path))
 			continue;
-		}
 
 		parse_conf_dynamic(path);
 	}
@@ -693,18 +817,23 @@ static void drop_changes(void)
 
 	TAILQ_FOREACH_SAFE(node, &conf_change_list, link, tmp)
 		drop_change(node);
+
+	if (num_pending) {
+		num_coalesced = num_pending;
+		num_pending = 0;
+		num_reloads++;
+	}
 }
 
 static int do_change(char *name, uint32_t mask)
 {
 	struct conf_change *node;
 
+	/*
+	 * Removed files are recorded as well, their services are then
+	 * swept on an incremental reload.
+	 */
 	node = conf_find(name);
-	if (mask & (IN_DELETE | IN_MOVED_FROM)) {
-		drop_change(node);
-		return 0;
-	}
-
 	if (node) {
 		_d("Event already registered for %s ...", name);
 		return 0;
@@ -775,12 +904,74 @@ static void conf_cb(uev_t *w, void *arg, int events)
 			_pe("conf_monitor: Out of memory");
 			break;
 		}
+
+		if (num_pending++ == 0)
+			clock_gettime(CLOCK_MONOTONIC, &first_change);
 	}
 
+	conf_settle();
+}
+
+/*
+ * Called when .conf changes have settled, or the max latency since the
+ * first change has been reached.  The reload then handles all changes
+ * recorded so far in one go.
+ */
+static void settle_cb(void *arg)
+{
 	if (conf_any_change())
 		service_reload_dynamic();
 }
 
+/*
+ * Package upgrades and config management often write many files in a
+ * row.  Instead of one reload per inotify event, (re)start a timer and
+ * wait until no more changes have been seen for reload_settle_ms, but
+ * never longer than reload_latency_ms since the first change.
+ */
+static void conf_settle(void)
+{
+	struct timespec now;
+	int elapsed, delay;
+
+	if (!conf_any_change())
+		return;
+
+	if (reload_settle_ms <= 0) {
+		settle_cb(NULL);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec  - first_change.tv_sec)  * 1000 +
+		  (now.tv_nsec - first_change.tv_nsec) / 1000000;
+
+	delay = reload_settle_ms;
+	if (elapsed + delay > reload_latency_ms)
+		delay = reload_latency_ms - elapsed;
+	if (delay <= 0) {
+		settle_cb(NULL);
+		return;
+	}
+
+	_d("Reload in %d msec, %d event(s) pending", delay, num_pending);
+	settle.delay = delay;
+	schedule_work(&settle);
+}
+
+/**
+ * conf_reload_stats - Current reload settle window and statistics
+ * @st: Pointer to &struct init_reload, used by initctl
+ */
+void conf_reload_stats(struct init_reload *st)
+{
+	st->settle    = reload_settle_ms;
+	st->latency   = reload_latency_ms;
+	st->pending   = num_pending;
+	st->coalesced = num_coalesced;
+	st->reloads   = num_reloads;
+}
+
 static int add_watcher(uev_ctx_t *ctx, uev_t *w, char *path, uint32_t opt)
 {
 	struct stat st;
@@ -857,7 +1048,7 @@ int conf_monitor(uev_ctx_t *ctx)
 	rc += add_watcher(ctx, &w3, FINIT_RCSD "/enabled/", 0);
 	rc += add_watcher(ctx, &w4, FINIT_CONF, 0);
 
-	return rc + conf_reload();
+	return rc + conf_reload(1);
 }
 
 /*
@@ -29,20 +29,26 @@
 extern int logfile_size_max;
 extern int logfile_count_max;
 
+extern int reload_settle_ms;
+extern int reload_latency_ms;
+
 extern struct rlimit global_rlimit[];
 
+struct init_reload;
+
 int   str2rlim(char *str);
 char *rlim2str(int rlim);
 
 int  conf_init            (void);
-void conf_reload          (void);
+int  conf_reload          (int full);
 int  conf_any_change      (void);
 int  conf_changed         (char *file);
+void conf_reload_stats    (struct init_reload *st);
 int  conf_monitor         (uev_ctx_t *ctx);
 
 void conf_parse_cmdline   (void);
 int  conf_parse_runlevels (char *runlevels);
-void conf_parse_cond      (svc_t *svc, char *cond);
+int  conf_parse_cond      (svc_t *svc, char *cond);
 
 #endif	/* FINIT_CONF_H_ */
 
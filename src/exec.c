@@ -24,11 +24,16 @@
 
 #include "config.h"		/* Generated by configure script */
 
+#include <alloca.h>
 #include <ctype.h>		/* isdigit() */
 #include <dirent.h>
+#include <grp.h>		/* setgroups() */
+#include <sched.h>		/* clone() */
+#include <poll.h>
 #include <stdarg.h>
 #include <sys/ioctl.h>
 #include <sys/prctl.h>
+#include <sys/signalfd.h>
 #include <sys/wait.h>
 #include <sys/ttydefaults.h>	/* Not included by default in musl libc */
 #include <termios.h>
@@ -41,6 +46,41 @@
 #include "utmp-api.h"
 
 #define NUM_ARGS    16
+#define RUN_MAX_JOBS 16		/* Max jobs in flight, incl. those not yet reported */
+#define RUN_MAX_OUT  4096	/* Max captured output per job */
+#define SPAWN_STACK_SIZE 65536	/* Stack for child until execve() */
+
+/*
+ * Asynchronous run jobs, started by run_async().  Jobs are started in
+ * parallel, up to @run_max at a time, and reported in the order they
+ * were started.  The table is static, a stale I/O event for a reused
+ * slot only hits a non-blocking read() that returns EAGAIN.
+ */
+struct run_job {
+	int       seq;		/* 0: free slot */
+	pid_t     pid;
+	int       done;
+	int       shown;
+	int       result;
+
+	char     *cmd;
+	char     *desc;		/* NULL: quiet job, no progress */
+	run_cb_t  cb;
+	void     *arg;
+
+	int       fd;		/* Read end of output pipe, or -1 */
+	uev_t     watcher;
+	char     *out;
+	size_t    len;
+};
+
+static struct run_job jobs[RUN_MAX_JOBS];
+static int run_seq  = 0;	/* Last started job */
+static int run_next = 1;	/* Next job to report */
+static int run_max  = RUN_MAX_JOBS;
+static int run_failed = 0;	/* Number of failed jobs, for run_wait() */
+static int run_sigfd  = -1;	/* SIGCHLD while waiting for jobs */
+static int run_sigchld = 0;	/* SIGCHLD consumed by job_poll() */
 
 
 /* Wait for process completion, returns status of waitpid(2) syscall */
@@ -62,18 +102,14 @@ int complete(char *cmd, int pid)
 	return status;
 }
 
-int run(char *cmd)
+/*
+ * Split command line into tokens of an argv[] array, @arg is modified.
+ * Returns number of arguments, or -1 if the command is too long.
+ */
+static int split_args(char *arg, char *args[])
 {
-	int status, result, i = 0;
-	char *args[NUM_ARGS + 1], *arg, *backup;
-	pid_t pid;
-
-	/* We must create a copy that is possible to modify. */
-	backup = arg = strdup(cmd);
-	if (!arg)
-		return 1; /* Failed allocating a string to be modified. */
+	int i = 0;
 
-	/* Split command line into tokens of an argv[] array. */
 	args[i++] = strsep(&arg, "\t ");
 	while (arg && i < NUM_ARGS) {
 		/* Handle run("su -c \"dbus-daemon --system\" messagebus");
@@ -94,9 +130,45 @@ int run(char *cmd)
 	args[i] = NULL;
 
 	if (i == NUM_ARGS && arg) {
+		errno = EOVERFLOW;
+		return -1;
+	}
+
+	return i;
+}
+
+/* Convert status of waitpid(2) to a result, signals are failures */
+static int exit_result(char *cmd, int status)
+{
+	int result = WEXITSTATUS(status);
+
+	if (WIFEXITED(status)) {
+		_d("Started %s and ended OK: %d", cmd, result);
+	} else if (WIFSIGNALED(status)) {
+		_d("Process %s terminated by signal %d", cmd, WTERMSIG(status));
+		if (!result)
+			result = 1; /* Must alert callee that the command did complete successfully.
+				     * This is necessary since not all programs trap signals and
+				     * change their return code accordingly. --Jocke */
+	}
+
+	return result;
+}
+
+int run(char *cmd)
+{
+	int status;
+	char *args[NUM_ARGS + 1], *backup;
+	pid_t pid;
+
+	/* We must create a copy that is possible to modify. */
+	backup = strdup(cmd);
+	if (!backup)
+		return 1; /* Failed allocating a string to be modified. */
+
+	if (split_args(backup, args) < 0) {
 		_e("Command too long: %s", cmd);
 		free(backup);
-		errno = EOVERFLOW;
 		return 1;
 	}
 
@@ -135,106 +207,555 @@ int run(char *cmd)
 		return 1;
 	}
 
-	result = WEXITSTATUS(status);
-	if (WIFEXITED(status)) {
-		_d("Started %s and ended OK: %d", args[0], result);
-	} else if (WIFSIGNALED(status)) {
-		_d("Process %s terminated by signal %d", args[0], WTERMSIG(status));
-		if (!result)
-			result = 1; /* Must alert callee that the command did complete successfully.
-				     * This is necessary since not all programs trap signals and
-				     * change their return code accordingly. --Jocke */
+	status = exit_result(args[0], status);
+	free(backup);
+
+	return status;
+}
+
+static struct run_job *job_find(int seq, pid_t pid)
+{
+	for (int i = 0; i < RUN_MAX_JOBS; i++) {
+		struct run_job *job = &jobs[i];
+
+		if (!job->seq)
+			continue;
+		if (seq && job->seq == seq)
+			return job;
+		if (pid && !job->done && job->pid == pid)
+			return job;
 	}
 
-	free(backup);
+	return NULL;
+}
 
-	return result;
+static int job_running(void)
+{
+	int num = 0;
+
+	for (int i = 0; i < RUN_MAX_JOBS; i++) {
+		if (jobs[i].seq && !jobs[i].done)
+			num++;
+	}
+
+	return num;
 }
 
-int run_interactive(char *cmd, char *fmt, ...)
+/* Read available output, keeps the first RUN_MAX_OUT bytes */
+static void job_read(struct run_job *job)
+{
+	char buf[256];
+	ssize_t len;
+
+	while ((len = read(job->fd, buf, sizeof(buf))) > 0) {
+		size_t room;
+
+		if (!job->out) {
+			job->out = malloc(RUN_MAX_OUT);
+			if (!job->out)
+				continue;
+		}
+
+		room = RUN_MAX_OUT - job->len;
+		if ((size_t)len > room)
+			len = room;
+		memcpy(&job->out[job->len], buf, len);
+		job->len += len;
+	}
+
+	/* EOF, all writers have exited */
+	if (!len) {
+		uev_io_stop(&job->watcher);
+		close(job->fd);
+		job->fd = -1;
+	}
+}
+
+static void job_cb(uev_t *w, void *arg, int events)
+{
+	struct run_job *job = arg;
+
+	if (job->fd != w->fd)
+		return;
+
+	job_read(job);
+}
+
+/*
+ * Report completed jobs, in the order they were started.  The first
+ * job still running has its description shown while waiting for it.
+ */
+static void job_report(void)
+{
+	static int busy = 0;
+	struct run_job *job;
+
+	if (busy)
+		return;
+	busy = 1;
+
+	while ((job = job_find(run_next, 0))) {
+		if (job->desc && !job->shown)
+			print_desc("", job->desc);
+		job->shown = 1;
+
+		if (!job->done)
+			break;
+
+		if (job->desc)
+			print_result(job->result);
+		if (job->result)
+			run_failed++;
+
+		/* Dump any output of failed job after we've printed [FAIL] */
+		if (job->result && job->len && !log_is_silent()) {
+			con_write(job->out, job->len);
+			if (job->out[job->len - 1] != '\n')
+				con_write("\n", 1);
+		}
+
+		if (job->cb)
+			job->cb(job->result, job->arg);
+
+		free(job->out);
+		free(job->desc);
+		free(job->cmd);
+		memset(job, 0, sizeof(*job));
+		run_next++;
+	}
+
+	busy = 0;
+}
+
+static void job_done(struct run_job *job, int status)
+{
+	if (job->fd >= 0) {
+		job_read(job);
+		if (job->fd >= 0) {
+			/* Daemonized child holds pipe, stop reading */
+			uev_io_stop(&job->watcher);
+			close(job->fd);
+			job->fd = -1;
+		}
+	}
+
+	job->result = exit_result(job->cmd, status);
+	job->done   = 1;
+}
+
+/*
+ * SIGCHLD is blocked when handled by the event loop, so a signalfd of
+ * our own wakes us up when a job exits.  Returns -1 if not possible,
+ * e.g., early at boot before the signal handlers are set up.
+ */
+static int job_sigfd(void)
+{
+	sigset_t mask;
+
+	sigprocmask(SIG_BLOCK, NULL, &mask);
+	if (!sigismember(&mask, SIGCHLD))
+		return -1;
+
+	if (run_sigfd < 0) {
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGCHLD);
+		run_sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+		if (run_sigfd < 0)
+			_pe("Failed creating signalfd for run jobs");
+	}
+
+	return run_sigfd;
+}
+
+/*
+ * Wait for progress on any running job.  Completion is collected with
+ * waitpid() for each job, to not steal any other child from Finit.  We
+ * sleep until a job's output or SIGCHLD arrives, any SIGCHLD consumed
+ * here is raised again by job_wait() for the event loop to collect
+ * other children.  Without a signalfd we fall back to a timeout.
+ */
+static void job_poll(void)
+{
+	struct pollfd pfd[RUN_MAX_JOBS + 1];
+	int i, fd, num = 0, msec = -1;
+
+	for (i = 0; i < RUN_MAX_JOBS; i++) {
+		struct run_job *job = &jobs[i];
+
+		if (!job->seq || job->done || job->fd < 0)
+			continue;
+
+		pfd[num].fd     = job->fd;
+		pfd[num].events = POLLIN;
+		num++;
+	}
+
+	fd = job_sigfd();
+	if (fd >= 0) {
+		pfd[num].fd     = fd;
+		pfd[num].events = POLLIN;
+		num++;
+	} else
+		msec = 100;
+
+	if (poll(pfd, num, msec) > 0) {
+		struct signalfd_siginfo si;
+
+		while (fd >= 0 && read(fd, &si, sizeof(si)) == sizeof(si))
+			run_sigchld = 1;
+
+		for (i = 0; i < RUN_MAX_JOBS; i++) {
+			struct run_job *job = &jobs[i];
+
+			if (job->seq && job->fd >= 0)
+				job_read(job);
+		}
+	}
+
+	for (i = 0; i < RUN_MAX_JOBS; i++) {
+		struct run_job *job = &jobs[i];
+		int status;
+
+		if (!job->seq || job->done)
+			continue;
+
+		if (waitpid(job->pid, &status, WNOHANG) == job->pid)
+			job_done(job, status);
+	}
+
+	job_report();
+}
+
+/* Wait for job @seq, and all before it, to be reported */
+static void job_wait(int seq)
+{
+	while (run_next <= seq)
+		job_poll();
+
+	/* Let sigchld_cb() collect any other children */
+	if (run_sigchld) {
+		run_sigchld = 0;
+		raise(SIGCHLD);
+	}
+}
+
+/**
+ * run_async - start a command without waiting for it to complete
+ * @cmd:  Command line, split on whitespace
+ * @desc: Progress description, or %NULL for a quiet job
+ * @cb:   Optional callback with the result of @cmd, must not wait
+ * @arg:  Argument to @cb
+ *
+ * Starts @cmd with stdout and stderr captured through a pipe, unless
+ * in debug mode.  The captured output is shown if @cmd fails.  Jobs
+ * are reported, and @cb called, in the order they were started.  If
+ * too many jobs are in flight, this function first waits for one to
+ * complete.
+ *
+ * Jobs complete either from the SIGCHLD handler, see run_reap(), or
+ * any call to run_wait(), e.g. at the end of a hook point.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero if @cmd could not be started.
+ */
+int run_async(char *cmd, char *desc, run_cb_t cb, void *arg)
 {
-	int status, oldout = 1, olderr = 2;
-	char line[LINE_SIZE];
-	FILE *fp;
+	char *args[NUM_ARGS + 1], *backup;
+	struct run_job *job = NULL;
+	int i, pfd[2] = { -1, -1 };
+	pid_t pid;
 
 	if (!cmd) {
 		errno = EINVAL;
 		return 1;
 	}
 
-	if (fmt) {
-		va_list ap;
+	while (job_running() >= run_max || !job) {
+		for (i = 0; i < RUN_MAX_JOBS; i++) {
+			if (!jobs[i].seq) {
+				job = &jobs[i];
+				break;
+			}
+		}
 
-		va_start(ap, fmt);
-		printv(fmt, ap);
-		va_end(ap);
+		if (!job || job_running() >= run_max)
+			job_poll();
 	}
 
-	/* Redirect output from cmd to a tempfile */
-	fp = tempfile();
-	if (fp && !log_is_debug()) {
-		oldout = dup(STDOUT_FILENO);
-		olderr = dup(STDERR_FILENO);
-		dup2(fileno(fp), STDOUT_FILENO);
-		dup2(fileno(fp), STDERR_FILENO);
+	if (run_sigchld) {
+		run_sigchld = 0;
+		raise(SIGCHLD);
 	}
 
-	/* Run cmd ... */
-	status = run(cmd);
+	backup = strdup(cmd);
+	if (!backup)
+		return 1;
+
+	if (split_args(backup, args) < 0) {
+		_e("Command too long: %s", cmd);
+		free(backup);
+		return 1;
+	}
 
-	/* Restore stderr/stdout */
-	if (fp && !log_is_debug()) {
-		if (oldout >= 0) {
-			dup2(oldout, STDOUT_FILENO);
-			close(oldout);
+	if (desc && !log_is_debug()) {
+		if (pipe2(pfd, O_CLOEXEC)) {
+			_pe("Failed creating output pipe for %s", args[0]);
+			pfd[0] = pfd[1] = -1;
 		}
-		if (olderr >= 0) {
-			dup2(olderr, STDERR_FILENO);
-			close(olderr);
+	}
+
+	pid = fork();
+	if (0 == pid) {
+		int fd;
+
+		/* Reset signal handlers that were set by the parent process */
+		sig_unblock();
+		setsid();
+
+		fd = open("/dev/null", O_RDWR);
+		if (fd >= 0)
+			dup2(fd, STDIN_FILENO);
+
+		if (pfd[1] >= 0) {
+			dup2(pfd[1], STDOUT_FILENO);
+			dup2(pfd[1], STDERR_FILENO);
+		} else if (!desc && fd >= 0) {
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
 		}
+
+		execvp(args[0], args);
+
+		_exit(1); /* Only if execv() fails. */
 	}
 
-	if (fmt)
-		print_result(status);
+	if (pfd[1] >= 0)
+		close(pfd[1]);
+
+	memset(job, 0, sizeof(*job));
+	job->seq  = ++run_seq;
+	job->pid  = pid;
+	job->cmd  = strdup(args[0]);
+	job->desc = desc ? strdup(desc) : NULL;
+	job->cb   = cb;
+	job->arg  = arg;
+	job->fd   = pfd[0];
+	free(backup);
+
+	if (-1 == pid) {
+		_pe("%s", job->cmd);
+		if (job->fd >= 0)
+			close(job->fd);
+		job->fd     = -1;
+		job->done   = 1;
+		job->result = 1;
+	} else if (job->fd >= 0) {
+		fcntl(job->fd, F_SETFL, O_NONBLOCK);
+		if (uev_io_init(ctx, &job->watcher, job_cb, job, job->fd, UEV_READ))
+			_pe("Failed watching output of %s", job->cmd);
+	}
+
+	_d("Started %s, pid %d, job %d", job->cmd, pid, job->seq);
+	job_report();
+
+	return 0;
+}
+
+/**
+ * run_reap - collect a run job from the SIGCHLD handler
+ * @pid:    PID of collected child
+ * @status: Exit status from waitpid()
+ *
+ * Returns:
+ * %TRUE(1) if @pid was a run job, otherwise %FALSE(0).
+ */
+int run_reap(pid_t pid, int status)
+{
+	struct run_job *job;
+
+	job = job_find(0, pid);
+	if (!job)
+		return 0;
+
+	job_done(job, status);
+	job_report();
+
+	return 1;
+}
+
+/**
+ * run_wait - wait for all run jobs to complete
+ *
+ * Blocks until all jobs started with run_async() have completed and
+ * been reported.  Used to synchronize at the end of a boot step.
+ *
+ * Returns:
+ * Number of jobs that failed while waiting.
+ */
+int run_wait(void)
+{
+	int failed = run_failed;
+
+	job_wait(run_seq);
+
+	return run_failed - failed;
+}
+
+/**
+ * run_limit - set max number of concurrent run jobs
+ * @num: Max number of jobs, zero for default
+ */
+void run_limit(int num)
+{
+	if (num <= 0 || num > RUN_MAX_JOBS)
+		num = RUN_MAX_JOBS;
+
+	run_max = num;
+}
+
+static void run_interactive_cb(int result, void *arg)
+{
+	*(int *)arg = result;
+}
 
-	/* Dump any results of cmd on stderr after we've printed [ OK ] or [FAIL]  */
-	if (fp && !log_is_debug()) {
-		size_t len, written;
+int run_interactive(char *cmd, char *fmt, ...)
+{
+	int status = 1;
+	char desc[LINE_SIZE] = "";
 
-		rewind(fp);
-		do {
-			len     = fread(line, 1, sizeof(line), fp);
-			written = fwrite(line, len, sizeof(char), stderr);
-		} while (len > 0 && written == len);
+	if (!cmd) {
+		errno = EINVAL;
+		return 1;
 	}
 
-	if (fp)
-		fclose(fp);
+	if (fmt) {
+		va_list ap;
+
+		va_start(ap, fmt);
+		vsnprintf(desc, sizeof(desc), fmt, ap);
+		va_end(ap);
+	}
+
+	if (run_async(cmd, fmt ? desc : NULL, run_interactive_cb, &status))
+		return 1;
+
+	/* Only wait for our own job, reported in order after earlier ones */
+	job_wait(run_seq);
 
 	return status;
 }
 
-int exec_runtask(char *cmd, char *args[])
+/* Command line for a run/task, called with sh -c */
+char *exec_runtask_cmdline(char *cmd, char *args[], char *buf, size_t len)
 {
 	size_t i;
-	char buf[1024] = "";
+
+	strlcpy(buf, cmd, len);
+	for (i = 1; args[i]; i++) {
+		strlcat(buf, " ", len);
+		strlcat(buf, args[i], len);
+	}
+
+	return buf;
+}
+
+int exec_runtask(char *cmd, char *args[])
+{
+	size_t i, len = strlen(cmd) + 1;
+	char *buf;
 	char *argv[4] = {
 		"sh",
 		"-c",
-		buf,
+		NULL,
 		NULL
 	};
 
-	strlcat(buf, cmd, sizeof(buf));
-	for (i = 1; args[i]; i++) {
-		strlcat(buf, " ", sizeof(buf));
-		strlcat(buf, args[i], sizeof(buf));
-	}
+	for (i = 1; args[i]; i++)
+		len += strlen(args[i]) + 1;
+	buf = alloca(len);
+	argv[2] = buf;
+
+	exec_runtask_cmdline(cmd, args, buf, len);
 	logit(LOG_DEBUG, "Calling %s %s", _PATH_BSHELL, buf);
 
 	return execvp(_PATH_BSHELL, argv);
 }
 
+/*
+ * Runs in the child, sharing memory with the suspended parent, so only
+ * system calls are allowed here.  Nothing may be written to memory
+ * except our own stack and @sp->err.
+ */
+static int spawn_child(void *arg)
+{
+	struct spawn *sp = arg;
+	struct sigaction sa;
+	sigset_t mask;
+	int i;
+
+	/* Reset signal handlers, the parent's handlers must never run here */
+	for (i = 1; i < NSIG; i++)
+		DFLSIG(sa, i, 0);
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+
+	for (i = 0; sp->rlimit && i < RLIMIT_NLIMITS; i++)
+		setrlimit(i, &sp->rlimit[i]);
+
+	if (sp->ngroups > 0)
+		setgroups(sp->ngroups, sp->groups);
+	if (sp->gid >= 0)
+		setgid(sp->gid);
+	if (sp->uid >= 0)
+		setuid(sp->uid);
+	if (sp->cwd)
+		chdir(sp->cwd);
+
+	for (i = 0; i < 3; i++) {
+		if (sp->fd[i] >= 0 && sp->fd[i] != i)
+			dup2(sp->fd[i], i);
+	}
+	for (i = 0; i < 3; i++) {
+		if (sp->fd[i] > STDERR_FILENO)
+			close(sp->fd[i]);
+	}
+
+	execve(sp->path, sp->argv, sp->envp);
+	sp->err = errno;
+
+	_exit(1);
+}
+
+/**
+ * exec_spawn - fast start of a process, without fork()
+ * @sp: Everything the child needs, prepared by the caller
+ *
+ * Starts a process with clone(CLONE_VM | CLONE_VFORK), so no page
+ * tables of PID 1 are copied and no copy-on-write faults follow in PID
+ * 1 after the start.  The caller is suspended until the child has
+ * called execve(), so a single static stack is enough.  All signals
+ * are blocked meanwhile, the child resets them before execve().
+ *
+ * Returns:
+ * PID of the new process, or -1 on error.  If execve() failed the
+ * child has exited and @sp->err is set.
+ */
+pid_t exec_spawn(struct spawn *sp)
+{
+	static char stack[SPAWN_STACK_SIZE] __attribute__ ((aligned (16)));
+	sigset_t all, omask;
+	pid_t pid;
+
+	sp->err = 0;
+
+	sigfillset(&all);
+	sigprocmask(SIG_BLOCK, &all, &omask);
+	pid = clone(spawn_child, &stack[sizeof(stack)], CLONE_VM | CLONE_VFORK | SIGCHLD, sp);
+	sigprocmask(SIG_SETMASK, &omask, NULL);
+
+	return pid;
+}
+
 static void prepare_tty(char *tty, speed_t speed, char *procname, struct rlimit rlimit[])
 {
 	struct sigaction sa;
@@ -29,9 +29,11 @@
 #ifdef HAVE_FSTAB_H
 #include <fstab.h>
 #endif
+#include <limits.h>		/* PATH_MAX */
 #include <mntent.h>
 #include <sys/mount.h>
 #include <sys/stat.h>		/* umask(), mkdir() */
+#include <sys/sysmacros.h>	/* major(), minor() */
 #include <sys/wait.h>
 #include <lite/lite.h>
 
@@ -41,6 +43,7 @@
 #include "conf.h"
 #include "helpers.h"
 #include "private.h"
+#include "resolve.h"
 #include "plugin.h"
 #include "service.h"
 #include "sig.h"
@@ -65,7 +68,17 @@ char *runparts  = NULL;
 uev_ctx_t *ctx  = NULL;		/* Main loop context */
 svc_t *wdog     = NULL;		/* No watchdog by default */
 
+int   fsck_max  = 0;		/* Max parallel fsck, 0: default */
+
 static int udev = 0;		/* Runtime detection of udev */
+static int fsck_failed = 0;	/* Uncorrected errors found by fsck */
+
+struct fsck_dev {
+	char *spec;
+	char *disk;
+	int   round;
+	int   result;
+};
 
 
 /*
@@ -111,24 +124,130 @@ static int fismnt(char *dir)
 	return ismnt("/proc/mounts", dir);
 }
 
+/*
+ * Resolve UUID= or LABEL= with findfs, if available.  The by-uuid and
+ * by-label symlinks in /dev/disk are only created later, by udev.
+ */
+static char *fsck_findfs(char *spec, char *dev, size_t len)
+{
+	char *args[] = { "findfs", spec, NULL };
+	int pfd[2], status;
+	ssize_t num;
+	pid_t pid;
+
+	if (!whichp("findfs") || pipe2(pfd, O_CLOEXEC))
+		return NULL;
+
+	pid = fork();
+	if (0 == pid) {
+		dup2(pfd[1], STDOUT_FILENO);
+		execvp(args[0], args);
+		_exit(1);
+	}
+	close(pfd[1]);
+
+	num = -1;
+	if (pid > 0)
+		num = read(pfd[0], dev, len - 1);
+	close(pfd[0]);
+
+	if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status))
+		return NULL;
+	if (num <= 0)
+		return NULL;
+
+	dev[num] = 0;
+	chomp(dev);
+
+	return dev;
+}
+
+/*
+ * Find the disk of a block device, e.g. sda for /dev/sda1, used to
+ * only check one filesystem per disk at a time.  Falls back to @spec
+ * itself if the disk cannot be found, e.g. for dm or md devices.  Any
+ * UUID= or LABEL= that cannot be resolved share one disk, so they are
+ * checked one at a time, they may very well be on the same disk.
+ */
+static char *fsck_disk(char *spec, char *disk, size_t len)
+{
+	char path[PATH_MAX], real[PATH_MAX], *dev = spec, *ptr;
+	int tag = 0;
+	struct stat st;
+
+	if (string_match(spec, "UUID=")) {
+		snprintf(path, sizeof(path), "/dev/disk/by-uuid/%s", &spec[5]);
+		dev = path;
+		tag = 1;
+	} else if (string_match(spec, "LABEL=")) {
+		snprintf(path, sizeof(path), "/dev/disk/by-label/%s", &spec[6]);
+		dev = path;
+		tag = 1;
+	}
+
+	if (tag && stat(dev, &st))
+		dev = fsck_findfs(spec, path, sizeof(path));
+
+	if (!dev || stat(dev, &st) || !S_ISBLK(st.st_mode))
+		goto fallback;
+
+	snprintf(path, sizeof(path), "/sys/dev/block/%u:%u", major(st.st_rdev), minor(st.st_rdev));
+	if (!realpath(path, real))
+		goto fallback;
+
+	/* Partitions are listed in sysfs below their disk, .../sda/sda1 */
+	snprintf(path, sizeof(path), "%s/partition", real);
+	if (fexist(path)) {
+		ptr = strrchr(real, '/');
+		if (ptr)
+			*ptr = 0;
+	}
+
+	ptr = strrchr(real, '/');
+	if (!ptr)
+		goto fallback;
+
+	strlcpy(disk, ++ptr, len);
+	return disk;
+fallback:
+	strlcpy(disk, tag ? "UUID/LABEL" : spec, len);
+	return disk;
+}
+
+/* Exit codes from fsck, 4 and up are uncorrected errors */
+static void fsck_cb(int result, void *arg)
+{
+	struct fsck_dev *dev = arg;
+
+	dev->result = result;
+	if (result >= 4) {
+		logit(LOG_CRIT, "Filesystem %s has errors, fsck exit code %d", dev->spec, result);
+		fsck_failed = 1;
+	}
+}
+
 /*
  * Check all filesystems in /etc/fstab with a fs_passno > 0
+ *
+ * All devices in the same pass are checked in parallel, up to the
+ * number set with finit.fsck_max=N on the kernel command line.  More
+ * than one filesystem on the same disk is checked in rounds, so that
+ * each disk only has one fsck at a time.
  */
 static int fsck(int pass)
 {
-//	int save;
+	struct fsck_dev *devs = NULL;
 	struct fstab *fs;
+	int i, j, num = 0, rounds = 0;
 
 	if (!setfsent()) {
 		_pe("Failed opening fstab");
 		return 1;
 	}
 
-//	if ((save = log_is_debug()))
-//		log_debug();
-
 	while ((fs = getfsent())) {
-		char cmd[80];
+		char disk[PATH_MAX];
+		struct fsck_dev *dev;
 		struct stat st;
 
 		if (fs->fs_passno != pass)
@@ -147,14 +266,58 @@ static int fsck(int pass)
 			continue;
 		}
 
-		snprintf(cmd, sizeof(cmd), "fsck -a %s", fs->fs_spec);
-		run_interactive(cmd, "Checking filesystem %.13s", fs->fs_spec);
-	}
+		dev = realloc(devs, (num + 1) * sizeof(*devs));
+		if (!dev) {
+			_pe("Failed allocating fsck of %s", fs->fs_spec);
+			continue;
+		}
+		devs = dev;
+
+		dev = &devs[num];
+		memset(dev, 0, sizeof(*dev));
+		dev->spec = strdup(fs->fs_spec);
+		dev->disk = strdup(fsck_disk(fs->fs_spec, disk, sizeof(disk)));
+		if (!dev->spec || !dev->disk) {
+			_pe("Failed allocating fsck of %s", fs->fs_spec);
+			free(dev->spec);
+			free(dev->disk);
+			continue;
+		}
+		num++;
 
-//	if (save)
-//		log_debug();
+		/* Nth filesystem on a disk is checked in round N */
+		for (i = 0; i < num - 1; i++) {
+			if (!strcmp(devs[i].disk, dev->disk))
+				dev->round++;
+		}
+		if (dev->round >= rounds)
+			rounds = dev->round + 1;
+	}
 	endfsent();
 
+	run_limit(fsck_max);
+	for (j = 0; j < rounds; j++) {
+		for (i = 0; i < num; i++) {
+			struct fsck_dev *dev = &devs[i];
+			char cmd[PATH_MAX + 10], desc[80];
+
+			if (dev->round != j)
+				continue;
+
+			snprintf(cmd, sizeof(cmd), "fsck -a %s", dev->spec);
+			snprintf(desc, sizeof(desc), "Checking filesystem %.13s", dev->spec);
+			run_async(cmd, desc, fsck_cb, dev);
+		}
+		run_wait();
+	}
+	run_limit(0);
+
+	for (i = 0; i < num; i++) {
+		free(devs[i].spec);
+		free(devs[i].disk);
+	}
+	free(devs);
+
 	return 0;
 }
 
@@ -262,6 +425,43 @@ static void finalize(void)
 	tty_runlevel();
 }
 
+/*
+ * Resume bootstrap when all SVC_TYPE_RUNTASK have completed their work
+ * in [S], or at timeout, whichever comes first.
+ */
+static struct wq final;
+static struct wq final_timeout;
+
+static void final_worker(void *work)
+{
+	static int done = 0;
+
+	if (done)
+		return;
+	done = 1;
+
+	if (work == &final_timeout) {
+		_d("Timeout, resuming bootstrap.");
+		service_completed(NULL);
+		service_step_all(SVC_TYPE_ANY);
+	} else {
+		_d("All run/task have completed, resuming bootstrap.");
+		tmo_stop(&final_timeout.tmo);
+	}
+
+	finalize();
+}
+
+static struct wq final = {
+	.cb = final_worker
+};
+
+/* Should not take more than 120 sec. */
+static struct wq final_timeout = {
+	.cb    = final_worker,
+	.delay = 120000
+};
+
 /*
  * Start cranking the big state machine
  */
@@ -274,35 +474,13 @@ static void crank_worker(void *unused)
 	sm_init(&sm);
 	sm_step(&sm);
 
+	_d("Waiting for bootstrap run/tasks to complete ...");
+	service_completed(&final);
+	schedule_work(&final_timeout);
+
 	/* Debian has this little script to copy generated rules while the system was read-only */
 	if (udev && fexist("/lib/udev/udev-finish"))
-		run_interactive("/lib/udev/udev-finish", "Finalizing udev");
-}
-
-/*
- * Wait for system bootstrap to complete, all SVC_TYPE_RUNTASK must be
- * allowed to complete their work in [S], or timeout, before we call
- * finalize(), should not take more than 120 sec.
- */
-static void final_worker(void *work)
-{
-	static int cnt = 120;
-
-	_d("Step all services ...");
-	service_step_all(SVC_TYPE_ANY);
-
-	if (cnt-- > 0 && !service_completed()) {
-		_d("Not all bootstrap run/tasks have completed yet ... %d", cnt);
-		schedule_work(work);
-		return;
-	}
-
-	if (cnt > 0)
-		_d("All run/task have completed, resuming bootstrap.");
-	else
-		_d("Timeout, resuming bootstrap.");
-
-	finalize();
+		run_async("/lib/udev/udev-finish", "Finalizing udev", NULL, NULL);
 }
 
 int main(int argc, char *argv[])
@@ -310,10 +488,6 @@ int main(int argc, char *argv[])
 	struct wq crank = {
 		.cb = crank_worker
 	};
-	struct wq final = {
-		.cb = final_worker,
-		.delay = 1000
-	};
 	uev_ctx_t loop;
 	char *path;
 	char cmd[256];
@@ -343,6 +517,7 @@ int main(int argc, char *argv[])
 	 */
 	uev_init1(&loop, 1);
 	ctx = &loop;
+	tmo_init(ctx);
 
 	/*
 	 * Set PATH and SHELL early to something sane
@@ -362,6 +537,11 @@ int main(int argc, char *argv[])
 	if (fisdir("/proc/bus/usb"))
 		mount("none", "/proc/bus/usb", "usbfs", 0, NULL);
 
+	/*
+	 * Cache of command paths and credentials, needs /proc/self/mounts
+	 */
+	resolve_init(ctx);
+
 	/*
 	 * Initialize default control groups, if available
 	 */
@@ -419,7 +599,7 @@ int main(int argc, char *argv[])
 	if (!fismnt("/dev"))
 		mount("udev", "/dev", "devtmpfs", MS_RELATIME, "size=10%,nr_inodes=61156,mode=755");
 	else if (whichp("udevadm"))
-		run_interactive("udevadm info --cleanup-db", "Cleaning up udev db");
+		run_async("udevadm info --cleanup-db", "Cleaning up udev db", NULL, NULL);
 
 	/* Some systems use /dev/pts */
 	makedir("/dev/pts", 0755);
@@ -446,6 +626,9 @@ int main(int argc, char *argv[])
 	/* Bootstrap conditions, needed for hooks */
 	cond_init();
 
+	/* Cleanup of udev db must complete before udevd is started */
+	run_wait();
+
 	/*
 	 * Populate /dev and prepare for runtime events from kernel.
 	 * Prefer udev if mdev is also available on the system.
@@ -511,13 +694,13 @@ int main(int argc, char *argv[])
 		plugin_run_hooks(HOOK_ROOTFS_UP);
 
 		umask(0);
-		if (run_interactive("mount -na", "Mounting filesystems"))
+		if (run_interactive("mount -na", "Mounting filesystems") || fsck_failed)
 			plugin_run_hooks(HOOK_MOUNT_ERROR);
 
 		_d("Calling extra mount hook, after mount -a ...");
 		plugin_run_hooks(HOOK_MOUNT_POST);
 
-		run("swapon -ea");
+		run_async("swapon -ea", NULL, NULL, NULL);
 		umask(0022);
 	}
 
@@ -542,8 +725,8 @@ int main(int argc, char *argv[])
 	_d("Starting the big state machine ...");
 	schedule_work(&crank);
 
-	_d("Starting bootstrap finalize timer ...");
-	schedule_work(&final);
+	/* Queue progress output, slow consoles must not block the loop */
+	print_init(&loop);
 
 	/*
 	 * Enter main loop to monitor /dev/initctl and services
@@ -76,10 +76,13 @@
 #define INIT_CMD_QUERY_INETD    14
 #define INIT_CMD_UNUSED1        15   /* Unused, was INIT_CMD_EMIT */
 #define INIT_CMD_GET_RUNLEVEL   16
+#define INIT_CMD_GET_RELOAD     17   /* Reload settle window and stats */
+#define INIT_CMD_GET_POOL       18   /* Object pool usage and stats */
 #define INIT_CMD_WDOG_HELLO     128  /* Watchdog register and hello */
 #define INIT_CMD_SVC_ITER       129
 #define INIT_CMD_SVC_QUERY      130
 #define INIT_CMD_SVC_FIND       131
+#define INIT_CMD_SVC_LOG        132  /* Recent output, from position */
 #define INIT_CMD_NACK           254
 #define INIT_CMD_ACK            255
 
@@ -92,12 +95,35 @@ struct init_request {
 	char	data[368];
 };
 
+/* Reply to INIT_CMD_GET_RELOAD, in data[] of struct init_request */
+struct init_reload {
+	int	settle;		/* Settle window, msec		*/
+	int	latency;	/* Max latency, msec		*/
+	int	pending;	/* Events waiting to settle	*/
+	int	coalesced;	/* Events handled by last reload */
+	int	reloads;	/* Reloads of coalesced events	*/
+};
+
+/* Reply to INIT_CMD_GET_POOL, array in data[], ends with empty name */
+struct init_pool {
+	char	name[12];
+	int	size;		/* Object size, bytes		*/
+	int	per_slab;	/* Objects per slab		*/
+	int	slabs;		/* Slabs allocated		*/
+	int	inuse;		/* Objects in use		*/
+	int	peak;		/* Max objects in use		*/
+	unsigned int allocs;	/* Total allocations		*/
+	unsigned int recycled;	/* Allocations from free list	*/
+	unsigned int released;	/* Slabs returned to heap	*/
+};
+
 extern int    runlevel;
 extern int    cfglevel;
 extern int    prevlevel;
 extern int    rescue;
 extern int    single;
 extern int    splash;
+extern int    fsck_max;
 extern char  *rcsd;
 extern char  *sdown;
 extern char  *network;
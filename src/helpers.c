@@ -24,6 +24,7 @@
 
 #include <ctype.h>		/* isblank() */
 #include <errno.h>
+#include <fcntl.h>
 #include <grp.h>
 #include <pwd.h>
 #include <limits.h>
@@ -39,6 +40,22 @@
 #include "util.h"
 #include "utmp-api.h"
 
+/*
+ * Progress output is queued and written to the console when it is
+ * writable, so a slow serial console does not hold up the event loop.
+ * When the backlog does not fit in the queue, messages are skipped and
+ * the number skipped is shown when the console has caught up.  Before
+ * print_init(), and after print_exit(), output is written directly.
+ */
+#define CON_QUEUE_SIZE 4096
+
+static uev_t  con_watcher;
+static int    con_fd = -1;		/* Non-blocking, when queueing */
+static int    con_nl = 1;		/* Last output ended with newline */
+static int    con_skipped;
+static size_t con_len;
+static char   con_buf[CON_QUEUE_SIZE];
+
 static int progress_style = PROGRESS_STYLE;
 
 /*
@@ -129,6 +146,156 @@ static char *pad(char *buf, size_t len, char *ch, size_t width)
 	return buf;
 }
 
+static void con_skip_summary(void)
+{
+	con_len = snprintf(con_buf, sizeof(con_buf), "%s%d messages not shown, console too slow\n",
+			   con_nl ? "" : "\n", con_skipped);
+	con_skipped = 0;
+	con_nl = 1;
+}
+
+static void con_cb(uev_t *w, void *arg, int events)
+{
+	ssize_t num;
+
+	num = write(w->fd, con_buf, con_len);
+	if (num < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return;
+		con_len = 0;	/* Console gone, drop backlog */
+	} else {
+		memmove(con_buf, &con_buf[num], con_len - num);
+		con_len -= num;
+	}
+
+	if (con_len)
+		return;
+
+	if (con_skipped)
+		con_skip_summary();
+	else
+		uev_io_stop(w);
+}
+
+/**
+ * con_write - write to the console, queued after print_init()
+ * @buf: Output
+ * @len: Length of @buf
+ *
+ * All output from PID 1 to the console goes through here, so it is
+ * neither interleaved with, nor blocked by, the queued output.
+ */
+void con_write(const char *buf, size_t len)
+{
+	ssize_t num;
+
+	if (!len)
+		return;
+
+	if (con_fd < 0) {
+		(void)write(STDERR_FILENO, buf, len);
+		return;
+	}
+
+	if (con_skipped || con_len + len > sizeof(con_buf)) {
+		con_skipped++;
+		return;
+	}
+	con_nl = buf[len - 1] == '\n';
+
+	if (!con_len) {
+		num = write(con_fd, buf, len);
+		if (num > 0) {
+			buf += num;
+			len -= num;
+		}
+		if (!len)
+			return;
+		uev_io_start(&con_watcher);
+	}
+
+	memcpy(&con_buf[con_len], buf, len);
+	con_len += len;
+}
+
+void con_printf(const char *fmt, ...)
+{
+	char buf[LINE_SIZE];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	if (len > 0)
+		con_write(buf, min((size_t)len, sizeof(buf) - 1));
+}
+
+/**
+ * print_init - queue console output from now on
+ * @ctx: libuEv context, the main loop
+ *
+ * Output is written to a separate, non-blocking, descriptor for the
+ * console, so services sharing it with Finit are not affected.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero if output is written directly, as before.
+ */
+int print_init(uev_ctx_t *ctx)
+{
+	int fd;
+
+	fd = open("/proc/self/fd/2", O_WRONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+	if (fd < 0)
+		return 1;
+
+	/* Fails on /dev/null, which does not need a queue anyway */
+	if (uev_io_init(ctx, &con_watcher, con_cb, NULL, fd, UEV_WRITE)) {
+		close(fd);
+		return 1;
+	}
+	uev_io_stop(&con_watcher);
+	con_fd = fd;
+
+	return 0;
+}
+
+/**
+ * print_exit - write any queued console output and stop queueing
+ *
+ * Blocks until the queue has been written, e.g. at shutdown.
+ */
+void print_exit(void)
+{
+	int fd = con_fd;
+
+	if (fd < 0)
+		return;
+
+	uev_io_stop(&con_watcher);
+	con_fd = -1;
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+	while (con_len) {
+		ssize_t num;
+
+		num = write(fd, con_buf, con_len);
+		if (num < 0) {
+			if (errno == EINTR)
+				continue;
+			con_len = 0;	/* Console gone, drop backlog */
+		} else {
+			memmove(con_buf, &con_buf[num], con_len - num);
+			con_len -= num;
+		}
+
+		if (!con_len && con_skipped)
+			con_skip_summary();
+	}
+	close(fd);
+}
+
 void print_banner(const char *heading)
 {
 	char buf[4 * SCREEN_WIDTH];
@@ -153,7 +320,7 @@ void print_banner(const char *heading)
 	}
 	strlcat(buf, "\e[0m\n", sizeof(buf));
 
-	(void)write(STDERR_FILENO, buf, strlen(buf));
+	con_write(buf, strlen(buf));
 }
 
 static size_t print_timestamp(char *buf, size_t len)
@@ -198,26 +365,27 @@ static char *status(int rc)
 
 void printv(const char *fmt, va_list ap)
 {
-	char buf[SCREEN_WIDTH];
+	char buf[SCREEN_WIDTH], line[2 * SCREEN_WIDTH];
 	size_t len;
 
 	if (!fmt || log_is_silent())
 		return;
 
-	delline();
-
 	memset(buf, 0, sizeof(buf));
 	len = print_timestamp(buf, sizeof(buf));
 	vsnprintf(&buf[len], sizeof(buf) - len, fmt, ap);
 
 	if (progress_style == 1)
-		fprintf(stderr, "\r%s ", pad(buf, sizeof(buf), ".", sizeof(buf)));
+		len = snprintf(line, sizeof(line), "\r\e[2K%s ", pad(buf, sizeof(buf), ".", sizeof(buf)));
 	else
-		fprintf(stderr, "\r\e[2K%s%s", status(3), buf);
+		len = snprintf(line, sizeof(line), "\r\e[2K%s%s", status(3), buf);
+	con_write(line, min(len, sizeof(line) - 1));
 }
 
 void print(int rc, const char *fmt, ...)
 {
+	char line[80];
+
 	if (log_is_silent())
 		return;
 
@@ -233,9 +401,10 @@ void print(int rc, const char *fmt, ...)
 		return;
 
 	if (progress_style == 1)
-		fprintf(stderr, "%s\n", status(rc));
+		snprintf(line, sizeof(line), "%s\n", status(rc));
 	else
-		fprintf(stderr, ".\r%s\n", status(rc));
+		snprintf(line, sizeof(line), ".\r%s\n", status(rc));
+	con_write(line, strlen(line));
 }
 
 void print_desc(char *action, char *desc)
@@ -314,15 +483,17 @@ done:
 
 static void ifup(char *ifname, int updown)
 {
-	char cmd[80];
+	char cmd[80], desc[80];
 
 	if (updown) {
 		snprintf(cmd, sizeof(cmd), "ifup %s", ifname);
-		run_interactive(cmd, "Bringing up interface %s", ifname);
+		snprintf(desc, sizeof(desc), "Bringing up interface %s", ifname);
 	} else {
 		snprintf(cmd, sizeof(cmd), "ifdown -f %s", ifname);
-		run_interactive(cmd, "Taking down interface %s", ifname);
+		snprintf(desc, sizeof(desc), "Taking down interface %s", ifname);
 	}
+
+	run_async(cmd, desc, NULL, NULL);
 }
 
 /*
@@ -374,6 +545,9 @@ void networking(int updown)
 		}
 
 		fclose(fp);
+
+		/* Interfaces are brought up/down in parallel */
+		run_wait();
 	}
 
 done:
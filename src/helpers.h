@@ -31,6 +31,7 @@
 #include <sys/ttydefaults.h>	/* Not included by default in musl libc */
 #include <termios.h>
 #include <lite/lite.h>
+#include <uev/uev.h>
 #include "log.h"
 
 #ifndef HAVE_GETFSENT
@@ -57,6 +58,10 @@ int     sh              (char *tty);
 int     stty            (int fd, speed_t speed);
 speed_t stty_parse_speed(char *baud);
 
+int     print_init      (uev_ctx_t *ctx);
+void    print_exit      (void);
+void    con_write       (const char *buf, size_t len);
+void    con_printf      (const char *fmt, ...);
 void    print_banner    (const char *heading);
 void    printv          (const char *fmt, va_list ap);
 void    print           (int action, const char *fmt, ...);
@@ -68,10 +73,33 @@ int     getgroup        (char *group);
 void    set_hostname    (char **hostname);
 void    networking      (int updown);
 
+typedef void (*run_cb_t)(int result, void *arg);
+
+/* Child setup for exec_spawn(), prepared in the parent */
+struct spawn {
+	const char          *path;
+	char               **argv;
+	char               **envp;
+	const struct rlimit *rlimit;	/* RLIMIT_NLIMITS, or NULL */
+	int                  uid;	/* -1 to keep */
+	int                  gid;	/* -1 to keep */
+	int                  ngroups;	/* Supplementary groups, 0 to keep */
+	const gid_t         *groups;
+	const char          *cwd;	/* NULL to keep */
+	int                  fd[3];	/* stdio, -1 to keep */
+	int                  err;	/* errno from a failed execve() */
+};
+
 int     complete        (char *cmd, int pid);
 int     run             (char *cmd);
 int     run_interactive (char *cmd, char *fmt, ...);
+int     run_async       (char *cmd, char *desc, run_cb_t cb, void *arg);
+int     run_reap        (pid_t pid, int status);
+int     run_wait        (void);
+void    run_limit       (int num);
 int     exec_runtask    (char *cmd, char *args[]);
+char   *exec_runtask_cmdline(char *cmd, char *args[], char *buf, size_t len);
+pid_t   exec_spawn      (struct spawn *sp);
 pid_t   run_getty       (char *tty, char *baud, char *term,  int noclear, int nowait, struct rlimit rlimit[]);
 pid_t   run_getty2      (char *tty, char *cmd, char *args[], int noclear, int nowait, struct rlimit rlimit[]);
 pid_t   run_sh          (char *tty, int noclear, int nowait, struct rlimit rlimit[]);
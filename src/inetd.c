@@ -29,6 +29,7 @@
 #include <lite/lite.h>
 
 #include "finit.h"
+#include "cond.h"
 #include "inetd.h"
 #include "helpers.h"
 #include "private.h"
@@ -170,6 +171,7 @@ static void socket_cb(uev_t *w, void *arg, int events)
 	const char *conn = " connection";
 	char iifname[IF_NAMESIZE + 1] = "UNKNOWN";
 	char id[MAX_ID_LEN];
+	char desc[256];
 	int stdin;
 
 	_d("%s: Got socket event ...", svc->cmd);
@@ -204,6 +206,20 @@ static void socket_cb(uev_t *w, void *arg, int events)
 		return;
 	}
 
+	/* Interned, so only references are taken, except for desc */
+	snprintf(desc, sizeof(desc), "%s%s", svc->desc, conn);
+	if (svc_set_rlimit(task, svc->rlimit)  ||
+	    svc_argcopy(task, svc)             ||
+	    svc_strset(&task->cond, svc->cond) ||
+	    svc_strset(&task->desc, desc)      ||
+	    svc_strset(&task->name, svc->name)) {
+		logit(LOG_CRIT, "%s: Unable to allocate service for inetd client", svc->cmd);
+		if (svc->inetd.type == SOCK_STREAM)
+			close(stdin);
+		svc_del(task);
+		return;
+	}
+
 	if (!svc->inetd.forking) {
 		svc_busy(svc);
 		service_step(svc);
@@ -220,15 +236,11 @@ static void socket_cb(uev_t *w, void *arg, int events)
 	task->inetd.cmd  = svc->inetd.cmd;
 	task->inetd.type = svc->inetd.type;
 
-	memcpy(task->rlimit,   svc->rlimit,   sizeof(task->rlimit));
-	memcpy(task->cond,     svc->cond,     sizeof(task->cond));
+	cond_dep_copy(task, svc);
 	memcpy(task->username, svc->username, sizeof(task->username));
 	memcpy(task->group,    svc->group,    sizeof(task->group));
-	memcpy(task->args,     svc->args,     sizeof(task->args));
-	strlcpy(task->desc, svc->desc, sizeof(task->desc) - strlen(conn));
-	strlcat(task->desc, conn, sizeof(task->desc));
 	strlcpy(task->iifname, iifname, sizeof(task->iifname));
-	strlcpy(task->name, svc->name, sizeof(task->name));
+	svc_rehash(task);
 
 	task->stdin_fd = stdin;
 	service_step(task);
@@ -50,6 +50,9 @@ struct command {
 
 int verbose  = 0;
 int runlevel = 0;
+int follow   = 0;
+
+static int usage(int rc);
 
 static int runlevel_get(int *prevlevel)
 {
@@ -80,6 +83,46 @@ static int toggle_debug(char *arg)
 	return client_send(&rq, sizeof(rq));
 }
 
+/*
+ * Show the last @num lines, or all, of the output of service @arg kept
+ * by Finit, and any new output in follow mode, until the service is
+ * removed.  Returns -1 if Finit does not have the output of @arg.
+ */
+static int show_log(char *arg, int num)
+{
+	uint32_t pos = 0;
+	size_t len;
+	char *buf, *ptr;
+
+	buf = client_svc_log(arg, &pos, &len);
+	if (!buf)
+		return -1;
+
+	ptr = buf;
+	if (num > 0 && len > 0) {
+		/* Start of the last num lines, buf ends with a newline */
+		ptr = &buf[len - 1];
+		while (ptr > buf) {
+			if (ptr[-1] == '\n' && --num == 0)
+				break;
+			ptr--;
+		}
+	}
+	fwrite(ptr, &buf[len] - ptr, 1, stdout);
+
+	while (follow) {
+		fflush(stdout);
+		usleep(500000);
+
+		buf = client_svc_log(arg, &pos, &len);
+		if (!buf)
+			break;
+		fwrite(buf, len, 1, stdout);
+	}
+
+	return 0;
+}
+
 static int do_log(char *svc)
 {
 	char cmd[128];
@@ -87,6 +130,10 @@ static int do_log(char *svc)
 
 	if (!svc || !svc[0])
 		svc = "finit";
+	else if (!show_log(svc, 10))
+		return 0;
+
+	/* Finit itself, or service with output not collected by Finit */
 
 	if (!fexist(logfile))
 		logfile = "/var/log/syslog";
@@ -140,7 +187,58 @@ static int do_svc(int cmd, char *arg)
 	return client_send(&rq, sizeof(rq));
 }
 
-static int do_reload (char *arg) { return do_svc(INIT_CMD_RELOAD,      arg); }
+static int show_reload(void)
+{
+	struct init_request rq = {
+		.magic = INIT_MAGIC,
+		.cmd = INIT_CMD_GET_RELOAD,
+	};
+	struct init_reload *st = (struct init_reload *)rq.data;
+
+	if (client_send(&rq, sizeof(rq)))
+		return 1;
+
+	printf("Settle window  : %d msec, max %d msec\n", st->settle, st->latency);
+	printf("Pending events : %d\n", st->pending);
+	printf("Last reload    : %d events coalesced\n", st->coalesced);
+	printf("Reloads        : %d\n", st->reloads);
+
+	return 0;
+}
+
+static int show_pool(char *arg)
+{
+	struct init_request rq = {
+		.magic = INIT_MAGIC,
+		.cmd = INIT_CMD_GET_POOL,
+	};
+	struct init_pool *st = (struct init_pool *)rq.data;
+	size_t i;
+
+	if (client_send(&rq, sizeof(rq)))
+		return 1;
+
+	printf("POOL  SIZE  SLABS  IN USE  PEAK  ALLOCS  RECYCLED  RELEASED\n");
+	for (i = 0; i < sizeof(rq.data) / sizeof(*st) && st[i].name[0]; i++) {
+		printf("%-4s  %4d  %5d  %6d  %4d  %6u  %8u  %8u\n", st[i].name,
+		       st[i].size, st[i].slabs, st[i].inuse, st[i].peak,
+		       st[i].allocs, st[i].recycled, st[i].released);
+	}
+
+	return 0;
+}
+
+static int do_reload(char *arg)
+{
+	if (arg && arg[0]) {
+		if (string_match("status", arg))
+			return show_reload();
+
+		return usage(1);
+	}
+
+	return do_svc(INIT_CMD_RELOAD, arg);
+}
 
 /*
  * This is a wrapper for do_svc() that adds a simple sanity check of
@@ -172,10 +270,11 @@ static int do_restart(char *arg) { return do_startstop(INIT_CMD_RESTART_SVC, arg
 
 static void show_cond_one(const char *_conds)
 {
-	static char conds[MAX_COND_LEN];
-	char *cond;
+	char *conds, *cond;
 
-	strlcpy(conds, _conds, sizeof(conds));
+	conds = strdup(_conds);
+	if (!conds)
+		return;
 
 	putchar('<');
 
@@ -199,6 +298,7 @@ static void show_cond_one(const char *_conds)
 	}
 
 	putchar('>');
+	free(conds);
 }
 
 static int dump_one_cond(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftwbuf)
@@ -410,9 +510,14 @@ static int show_status(char *arg)
 		printf("Uptime      : %s\n", svc->pid ? uptime(now - svc->start_time, buf, sizeof(buf)) : buf);
 		printf("Runlevels   : %s\n", runlevel_string(runlevel, svc->runlevels));
 		printf("Status      : %s\n", svc_status(svc));
+		if (svc->log.rate || svc->log.bytes)
+			printf("Suppressed  : %u lines over log rate limit\n", svc->log.dropped);
 		printf("\n");
 
-		return do_log(svc->cmd);
+		/* Output not collected by Finit, fall back to syslog */
+		if (show_log(arg, 10))
+			return do_log(svc->cmd);
+		return 0;
 	}
 
 	if (!verbose)
@@ -476,10 +581,13 @@ static int show_status(char *arg)
 		else
 #endif /* INETD_ENABLED */
 		{
-			int i;
+			char *arg;
 
-			for (i = 1; i < MAX_NUM_SVC_ARGS; i++) {
-				strlcat(args, svc->args[i], sizeof(args));
+			/* Skip argv[0], the command */
+			svc_foreach_arg(svc, arg) {
+				if (arg == svc->args)
+					continue;
+				strlcat(args, arg, sizeof(args));
 				strlcat(args, " ", sizeof(args));
 			}
 
@@ -562,6 +670,7 @@ static int usage(int rc)
 		"\n"
 		"Options:\n"
 		"  -b, --batch               Batch mode, no screen size probing\n"
+		"  -f, --follow              Follow output of service, with log or status\n"
 		"  -v, --verbose             Verbose output\n"
 		"  -h, --help                This help text\n"
 		"\n"
@@ -575,12 +684,13 @@ static int usage(int rc)
 		"  disable  <CONF>           Disable  .conf in /etc/finit.d/[enabled/]\n"
 		"  touch    <CONF>           Mark     .conf in /etc/finit.d/ for reload\n"
 		"  reload                    Reload  *.conf in /etc/finit.d/ (activates changes)\n"
+		"  reload   status           Show settle window and coalesced .conf changes\n"
 //		"  reload   <JOB|NAME>[:ID]  Reload (SIGHUP) service by job# or name\n"
 		"\n"
 		"  cond     show             Show condition status\n"
 		"  cond     dump             Dump all conditions and their status\n"
 		"\n"
-		"  log      [NAME]           Show ten last Finit, or NAME, messages from syslog\n"
+		"  log      [NAME]           Show ten last Finit, or NAME, messages\n"
 		"  start    <JOB|NAME>[:ID]  Start service by job# or name, with optional ID\n"
 		"  stop     <JOB|NAME>[:ID]  Stop/Pause a running service by job# or name\n"
 		"  restart  <JOB|NAME>[:ID]  Restart (stop/start) service by job# or name\n"
@@ -588,6 +698,7 @@ static int usage(int rc)
 		"  status | show             Show status of services, default command\n"
 		"\n"
 		"  ps                        List processes based on cgroups\n"
+		"  pool                      Show svc_t pool usage and recycle stats\n"
 		"\n"
 		"  runlevel [0-9]            Show or set runlevel: 0 halt, 6 reboot\n"
 		"  reboot                    Reboot system\n"
@@ -630,6 +741,7 @@ int main(int argc, char *argv[])
 		{ "show",     show_status  }, /* Convenience alias */
 
 		{ "ps",       show_cgroup  },
+		{ "pool",     show_pool    },
 
 		{ "runlevel", do_runlevel  },
 		{ "reboot",   do_reboot    },
@@ -641,6 +753,7 @@ int main(int argc, char *argv[])
 	};
 	struct option long_options[] = {
 		{"batch",   0, NULL, 'b'},
+		{"follow",  0, NULL, 'f'},
 		{"help",    0, NULL, 'h'},
 		{"debug",   0, NULL, 'd'},
 		{"verbose", 0, NULL, 'v'},
@@ -648,12 +761,16 @@ int main(int argc, char *argv[])
 	};
 
 	progname(argv[0]);
-	while ((c = getopt_long(argc, argv, "bh?v", long_options, NULL)) != EOF) {
+	while ((c = getopt_long(argc, argv, "bfh?v", long_options, NULL)) != EOF) {
 		switch(c) {
 		case 'b':
 			interactive = 0;
 			break;
 
+		case 'f':
+			follow = 1;
+			break;
+
 		case 'h':
 		case '?':
 			return usage(0);
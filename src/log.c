@@ -22,16 +22,50 @@
  */
 
 #include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <paths.h>
 #include <sched.h>		/* sched_yield() */
 #include <stdio.h>
 #include <stdarg.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <lite/lite.h>
 
 #include "finit.h"
+#include "helpers.h"
 #include "log.h"
+#include "tmo.h"
 #include "util.h"
 
-static int up       = 0;
+/*
+ * Messages from PID 1 are queued and sent to syslogd on a non-blocking
+ * socket, so a slow or wedged syslogd cannot stall the event loop.  The
+ * queue is bounded, when full the oldest message is dropped, and the
+ * number of dropped messages is logged when syslogd catches up.
+ *
+ * Until syslogd is up, messages are also written to /dev/kmsg.  They are
+ * kept in the queue and replayed to syslogd when it appears.
+ */
+#define LOG_QUEUE_LEN 64
+#define LOG_MSG_MAX   256
+
+struct logmsg {
+	int     prio;
+	time_t  time;
+	char    msg[LOG_MSG_MAX];
+};
+
+static struct logmsg queue[LOG_QUEUE_LEN];
+static unsigned int  head, tail;	/* Next free, oldest */
+static unsigned int  dropped;
+static struct tmo    retry;
+static int           backoff;		/* msec */
+
+static int up       = 0;		/* Connected to syslogd once */
+static int sd       = -1;
+static int kmsg     = -1;
 static int debug    = 0;
 static int silent   = SILENT_MODE;	/* Completely silent, including boot */
 static int loglevel = LOG_NOTICE;
@@ -64,7 +98,7 @@ void log_exit(void)
 	muffler();
 	if (!silent) {
 		sched_yield();
-		fputs("\n", stderr);
+		con_write("\n", 1);
 	}
 
 	/*
@@ -77,18 +111,125 @@ void log_exit(void)
 		screen_init();
 }
 
+static int log_connect(void)
+{
+	struct sockaddr_un sun = { .sun_family = AF_UNIX, .sun_path = _PATH_LOG };
+
+	sd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sd < 0)
+		return -1;
+
+	if (connect(sd, (struct sockaddr *)&sun, sizeof(sun))) {
+		close(sd);
+		sd = -1;
+		return -1;
+	}
+
+	/* No more /dev/kmsg, syslogd gets the queue */
+	if (kmsg >= 0) {
+		close(kmsg);
+		kmsg = -1;
+	}
+	up = 1;
+
+	return 0;
+}
+
+/* Reconnect to syslogd, e.g. after it has been restarted */
 void log_open(void)
 {
-	int opts = LOG_PID;
+	if (sd >= 0)
+		close(sd);
+	sd = -1;
+}
+
+static int log_send(int sd, struct logmsg *m)
+{
+	char buf[LOG_MSG_MAX + 64], ts[16];
+	struct tm tm;
+	int prio, len;
+
+	prio = m->prio;
+	if (!LOG_FAC(prio))
+		prio |= LOG_DAEMON;
+
+	localtime_r(&m->time, &tm);
+	strftime(ts, sizeof(ts), "%b %e %H:%M:%S", &tm);
+	len = snprintf(buf, sizeof(buf), "<%d>%s finit[%d]: %s", prio, ts, getpid(), m->msg);
+	if (len >= (int)sizeof(buf))
+		len = sizeof(buf) - 1;
 
-	closelog();
+	return send(sd, buf, len, MSG_NOSIGNAL);
+}
+
+static void drain_cb(void *arg);
+
+/* Send queued messages, never blocks, retry later if syslogd is busy */
+static void drain(void)
+{
+	while (tail != head) {
+		if (sd < 0 && log_connect())
+			goto retry;
+
+		if (dropped) {
+			struct logmsg m = { .prio = LOG_WARNING, .time = time(NULL) };
+
+			snprintf(m.msg, sizeof(m.msg), "%u log messages dropped", dropped);
+			if (log_send(sd, &m) < 0)
+				goto fail;
+			dropped = 0;
+		}
+
+		if (log_send(sd, &queue[tail % LOG_QUEUE_LEN]) < 0)
+			goto fail;
+		tail++;
+	}
+
+	backoff = 0;
+	return;
+fail:
+	if (errno != EAGAIN) {
+		/* syslogd restarted, or gone */
+		close(sd);
+		sd = -1;
+	}
+retry:
+	if (!tmo_pending(&retry)) {
+		backoff = backoff ? min(backoff * 2, 10000) : 100;
+		tmo_start(&retry, backoff, drain_cb, NULL);
+	}
+}
+
+static void drain_cb(void *arg)
+{
+	drain();
+}
+
+/*
+ * Forked children of PID 1, before execve(), have a copy of the queue
+ * and must neither send it again nor touch the timers of PID 1.  Their
+ * messages are sent directly, or written to stderr.
+ */
+static void log_child(struct logmsg *m)
+{
+	struct sockaddr_un sun = { .sun_family = AF_UNIX, .sun_path = _PATH_LOG };
+	int fd;
 
 	if (debug)
-		opts |= LOG_PERROR; /* LOG_CONS | */
-	openlog("finit", opts, LOG_DAEMON);
-	setlogmask(LOG_UPTO(loglevel));
+		fprintf(stderr, "finit[%d]: %s\n", getpid(), m->msg);
+
+	fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd >= 0) {
+		if (!connect(fd, (struct sockaddr *)&sun, sizeof(sun)) &&
+		    log_send(fd, m) >= 0) {
+			close(fd);
+			return;
+		}
+		close(fd);
+	}
 
-	up = 1;
+	if (!debug)
+		fprintf(stderr, "finit[%d]: %s\n", getpid(), m->msg);
 }
 
 void log_silent(void)
@@ -134,44 +275,57 @@ int log_is_debug(void)
 }
 
 /*
- * Log to /dev/kmsg until syslogd has started, then openlog()
- * and continue logging as a regular daemon.
+ * Queue message for syslogd, and log to /dev/kmsg until syslogd has
+ * been up.  Never blocks.
  */
 void logit(int prio, const char *fmt, ...)
 {
-	FILE *fp;
+	struct logmsg msg, *m = &msg;
+	int saved = errno;
 	va_list ap;
+	size_t len;
 
-	va_start(ap, fmt);
+	if (!debug && LOG_PRI(prio) > loglevel)
+		return;
 
-	if (up || fexist("/dev/log")) {
-		if (!up)
-			log_open();
-		vsyslog(prio, fmt, ap);
-		goto done;
-	}
+	m->prio = prio;
+	m->time = time(NULL);
 
-	if (!debug && prio > loglevel)
-		goto done;
+	va_start(ap, fmt);
+	vsnprintf(m->msg, sizeof(m->msg), fmt, ap);
+	va_end(ap);
 
-	fp = fopen("/dev/kmsg", "w");
-	if (!fp) {
-		vfprintf(stderr, fmt, ap);
-		goto done;
+	len = strlen(m->msg);
+	while (len > 0 && m->msg[len - 1] == '\n')
+		m->msg[--len] = 0;
+
+	if (getpid() != 1) {
+		log_child(m);
+		errno = saved;
+		return;
 	}
 
-	fprintf(fp, "<%d>finit[1]:", LOG_DAEMON | prio);
-	vfprintf(fp, fmt, ap);
-	fclose(fp);
+	if (head - tail == LOG_QUEUE_LEN) {
+		tail++;
+		dropped++;
+	}
+	m = &queue[head++ % LOG_QUEUE_LEN];
+	*m = msg;
 
-	if (debug) {
-		va_end(ap);
-		va_start(ap, fmt);
-		vfprintf(stderr, fmt, ap);
+	if (debug)
+		con_printf("finit[1]: %s\n", m->msg);
+
+	if (!up && sd < 0 && log_connect()) {
+		if (kmsg < 0)
+			kmsg = open("/dev/kmsg", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+		if (kmsg >= 0)
+			dprintf(kmsg, "<%d>finit[1]:%s\n", LOG_DAEMON | LOG_PRI(prio), m->msg);
+		else if (!debug)
+			con_printf("%s\n", m->msg);
 	}
 
-done:
-	va_end(ap);
+	drain();
+	errno = saved;
 }
 
 /**
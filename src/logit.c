@@ -23,13 +23,17 @@
 #include <config.h>
 #include <errno.h>
 #include <getopt.h>
+#include <limits.h>		/* INT_MAX */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #define SYSLOG_NAMES
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/poll.h>
 #include <sys/stat.h>
+#include <lite/lite.h>
 
 static const char version_info[] = PACKAGE_NAME " v" PACKAGE_VERSION;
 
@@ -99,50 +103,146 @@ static int logrotate(char *file, int num, off_t sz)
 	return 0;
 }
 
-static int checksz(FILE *fp, off_t sz)
+static long long now_ms(void)
 {
-	struct stat st;
-
-	if (sz <= 0)
-		return 0;
+	struct timespec ts;
 
-	if (!fstat(fileno(fp), &st) && st.st_size > sz) {
-		fclose(fp);
-		return 1;
-	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	return 0;
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-static int flogit(char *logfile, int num, off_t sz, char *buf, size_t len)
+static FILE *fopen_log(char *logfile, off_t *size)
 {
+	struct stat st;
 	FILE *fp;
 
-reopen:
 	fp = fopen(logfile, "a");
 	if (!fp) {
 		syslog(LOG_ERR | LOG_PERROR, "Failed opening %s: %s", logfile, strerror(errno));
-		return 1;
+		return NULL;
 	}
 
+	/* We flush ourselves, see flogit() */
+	setvbuf(fp, NULL, _IOFBF, BUFSIZ);
+
+	*size = 0;
+	if (!fstat(fileno(fp), &st))
+		*size = st.st_size;
+
+	return fp;
+}
+
+/*
+ * Log stdin, or a single message in @buf, to @logfile.  Writes are
+ * batched: the file is kept open, written when @bufsz bytes are pending,
+ * when @interval msec has passed since the first pending line, or when
+ * no more input is ready and @interval is 0.  With @syncms the file is
+ * also fsync()'ed, at most once every @syncms msec.  The size is tracked
+ * from what is written, and the file rotated when it exceeds @sz.
+ */
+static int flogit(char *logfile, int num, off_t sz, char *buf, size_t len,
+		  size_t bufsz, int interval, int syncms)
+{
+	struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+	long long first = 0, synced = now_ms();
+	size_t pending = 0;
+	int unsynced = 0;
+	off_t size;
+	FILE *fp;
+
+	fp = fopen_log(logfile, &size);
+	if (!fp)
+		return 1;
+
 	if (buf[0]) {
 		fprintf(fp, "%s\n", buf);
+		fflush(fp);
 		fsync(fileno(fp));
-		if (checksz(fp, sz))
+		fclose(fp);
+
+		if (sz > 0 && size + (off_t)strlen(buf) + 1 > sz)
 			return logrotate(logfile, num, sz);
-	} else {
-		while ((fgets(buf, len, stdin))) {
-			fputs(buf, fp);
-			fsync(fileno(fp));
+		return 0;
+	}
+
+	while (1) {
+		int timeout = -1;
+		ssize_t n;
+		char *nl;
+
+		if (pending) {
+			timeout = interval - (int)(now_ms() - first);
+			if (timeout < 0)
+				timeout = 0;
+		} else if (unsynced) {
+			timeout = syncms - (int)(now_ms() - synced);
+			if (timeout < 0)
+				timeout = 0;
+		}
+
+		n = poll(&pfd, 1, timeout);
+		if (n == -1 && errno == EINTR)
+			continue;
 
-			if (checksz(fp, sz)) {
-				logrotate(logfile, num, sz);
-				buf[0] = 0;
-				goto reopen;
+		if (n == 0) {
+			/* Idle, or interval passed */
+			if (pending) {
+				fflush(fp);
+				pending = 0;
+				unsynced = syncms > 0;
 			}
+			goto sync;
+		}
+
+		n = read(STDIN_FILENO, buf, len);
+		if (n <= 0)
+			break;
+
+		if (!pending)
+			first = now_ms();
+
+		/* Rotate on a line boundary, if possible */
+		nl = memrchr(buf, '\n', n) ?: &buf[n - 1];
+		if (sz > 0 && size + (nl - buf + 1) > sz) {
+			size_t part = nl - buf + 1;
+
+			fwrite(buf, part, 1, fp);
+			fclose(fp);
+			logrotate(logfile, num, sz);
+
+			fp = fopen_log(logfile, &size);
+			if (!fp)
+				return 1;
+
+			memmove(buf, &buf[part], n - part);
+			n -= part;
+			pending = 0;
+			first = now_ms();
+		}
+
+		fwrite(buf, n, 1, fp);
+		size    += n;
+		pending += n;
+
+		/* Full, or a steady stream never lets poll() time out */
+		if (pending >= bufsz || (interval > 0 && now_ms() - first >= interval)) {
+			fflush(fp);
+			pending = 0;
+			unsynced = syncms > 0;
+		}
+	sync:
+		if (unsynced && now_ms() - synced >= syncms) {
+			fsync(fileno(fp));
+			synced = now_ms();
+			unsynced = 0;
 		}
 	}
 
+	fflush(fp);
+	if (syncms)
+		fsync(fileno(fp));
+
 	return fclose(fp);
 }
 
@@ -187,6 +287,22 @@ static int parse_prio(char *arg, int *f, int *l)
 	return 0;
 }
 
+/* Keeps previous value if @arg is invalid */
+static int parse_num(const char *opt, char *arg, long long max, long long *num)
+{
+	const char *err = NULL;
+	long long val;
+
+	val = strtonum(arg, 0, max, &err);
+	if (err) {
+		fprintf(stderr, "logit: invalid %s value %s: %s\n", opt, arg, err);
+		return 1;
+	}
+
+	*num = val;
+	return 0;
+}
+
 static int usage(int code)
 {
 	fprintf(stderr, "Usage: logit [OPTIONS] [MESSAGE]\n"
@@ -201,6 +317,9 @@ static int usage(int code)
 		"  -f FILE  File to write log messages to, instead of syslog\n"
 		"  -n SIZE  Number of bytes before rotating, default: 200 kB\n"
 		"  -r NUM   Number of rotated files to keep, default: 5\n"
+		"  -b SIZE  Write to FILE when SIZE bytes are pending, default: 4096\n"
+		"  -i MSEC  Write to FILE at least every MSEC, default: 0, when idle\n"
+		"  -y MSEC  Sync FILE to disk at most every MSEC, default: 0, never\n"
 		"  -v       Show program version\n"
 		"\n"
 		"This version of logit is distributed as part of Finit.\n"
@@ -211,7 +330,8 @@ static int usage(int code)
 
 int main(int argc, char *argv[])
 {
-	int c, rc, num = 5;
+	int c, rc, num = 5, interval = 0, syncms = 0;
+	size_t bufsz = 4096;
 	int facility = LOG_USER;
 	int level = LOG_INFO;
 	int log_opts = LOG_NOWAIT;
@@ -219,8 +339,16 @@ int main(int argc, char *argv[])
 	char *ident = NULL, *logfile = NULL;
 	char buf[512] = "";
 
-	while ((c = getopt(argc, argv, "f:hn:p:r:st:v")) != EOF) {
+	while ((c = getopt(argc, argv, "b:f:hi:n:p:r:st:vy:")) != EOF) {
+		long long val;
+
 		switch (c) {
+		case 'b':
+			if (parse_num("-b", optarg, INT_MAX, &val))
+				return usage(1);
+			bufsz = val;
+			break;
+
 		case 'f':
 			logfile = optarg;
 			break;
@@ -228,6 +356,12 @@ int main(int argc, char *argv[])
 		case 'h':
 			return usage(0);
 
+		case 'i':
+			if (parse_num("-i", optarg, INT_MAX, &val))
+				return usage(1);
+			interval = val;
+			break;
+
 		case 'n':
 			size = atoi(optarg);
 			break;
@@ -253,6 +387,12 @@ int main(int argc, char *argv[])
 			fprintf(stderr, "%s\n", version_info);
 			return 0;
 
+		case 'y':
+			if (parse_num("-y", optarg, INT_MAX, &val))
+				return usage(1);
+			syncms = val;
+			break;
+
 		default:
 			return usage(1);
 		}
@@ -276,7 +416,7 @@ int main(int argc, char *argv[])
 	openlog(ident, log_opts, facility);
 
 	if (logfile)
-		rc = flogit(logfile, num, size, buf, sizeof(buf));
+		rc = flogit(logfile, num, size, buf, sizeof(buf), bufsz, interval, syncms);
 	else
 		rc = logit(level, buf, sizeof(buf));
 
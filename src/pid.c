@@ -23,6 +23,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>		/* PATH_MAX */
 #include <paths.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -95,8 +96,8 @@ char *pid_get_name(pid_t pid, char *name, size_t len)
 
 char *pid_file(svc_t *svc)
 {
-	char fn[MAX_ARG_LEN];
-	static char path[256];
+	char fn[PATH_MAX];
+	static char path[PATH_MAX];
 
 	if (svc->pidfile[0]) {
 		if (svc->pidfile[0] == '!')
@@ -126,6 +127,7 @@ int pid_file_create(svc_t *svc)
 
 static int pid_realpath(svc_t *svc, char *file)
 {
+	char path[PATH_MAX + 1];
 	int not = 0;
 
 	if (!file)
@@ -136,11 +138,11 @@ static int pid_realpath(svc_t *svc, char *file)
 		file++;
 	}
 
-	pid_runpath(file, &svc->pidfile[not], sizeof(svc->pidfile) - not);
+	pid_runpath(file, &path[not], sizeof(path) - not);
 	if (not)
-		svc->pidfile[0] = '!';
+		path[0] = '!';
 
-	return 0;
+	return svc_strset(&svc->pidfile, path);
 }
 
 /*
@@ -179,7 +181,7 @@ int pid_file_parse(svc_t *svc, char *arg)
 	/* 'pid:' implies argument following*/
 	if (!strncmp(arg, "pid:", 4)) {
 		int len, not = 0;
-		char path[MAX_ARG_LEN];
+		char path[PATH_MAX];
 
 		arg += 4;
 		if ((arg[0] == '!' && arg[1] == '/') || arg[0] == '/')
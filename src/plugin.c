@@ -201,6 +201,9 @@ void plugin_run_hook(hook_point_t no, void *arg)
 		}
 	}
 
+	/* Any jobs started by hooks must complete before next step */
+	run_wait();
+
 	cond_set_oneshot(hook_cond[no]);
 	service_step_all(SVC_TYPE_RUNTASK);
 }
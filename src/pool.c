@@ -0,0 +1,193 @@
+/* Object pool, slab allocator with free lists
+ *
+ * Copyright (c) 2020  Joachim Nilsson <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <lite/lite.h>
+
+#include "pool.h"
+
+/* Header of each object, the object follows */
+struct pool_obj {
+	struct slab     *slab;
+	struct pool_obj *next;		/* Free list */
+} __attribute__ ((aligned));
+
+struct slab {
+	TAILQ_ENTRY(slab) link;
+	struct pool      *pool;
+	struct pool_obj  *free;		/* Recycled objects */
+	int               carved;	/* Objects handed out from mem[] */
+	int               used;
+	char              mem[] __attribute__ ((aligned));
+};
+
+/* Number of empty slabs to keep as spare */
+#define POOL_SPARE 1
+
+static size_t obj_size(struct pool *pool)
+{
+	return sizeof(struct pool_obj) + pool->size;
+}
+
+static struct slab *slab_new(struct pool *pool)
+{
+	struct slab *slab;
+
+	slab = malloc(sizeof(*slab) + pool->per_slab * obj_size(pool));
+	if (!slab)
+		return NULL;
+
+	slab->pool   = pool;
+	slab->free   = NULL;
+	slab->carved = 0;
+	slab->used   = 0;
+	TAILQ_INSERT_HEAD(&pool->partial, slab, link);
+	pool->slabs++;
+	pool->spare++;
+
+	return slab;
+}
+
+/**
+ * pool_alloc - Allocate a zeroed object from a pool
+ * @pool: Pointer to &struct pool, see POOL_INITIALIZER()
+ *
+ * Objects are taken from the free list of the first slab that has any,
+ * otherwise carved from a new slab.  Constant time, unless the pool
+ * needs to grow.
+ *
+ * Returns:
+ * A pointer to a zeroed object of @pool->size bytes, or %NULL.
+ */
+void *pool_alloc(struct pool *pool)
+{
+	struct pool_obj *obj;
+	struct slab *slab;
+
+	slab = TAILQ_FIRST(&pool->partial);
+	if (!slab) {
+		slab = slab_new(pool);
+		if (!slab) {
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	if (slab->free) {
+		obj = slab->free;
+		slab->free = obj->next;
+		pool->recycled++;
+	} else {
+		obj = (struct pool_obj *)&slab->mem[slab->carved * obj_size(pool)];
+		obj->slab = slab;
+		slab->carved++;
+	}
+
+	if (!slab->used++)
+		pool->spare--;
+	if (slab->used == pool->per_slab) {
+		TAILQ_REMOVE(&pool->partial, slab, link);
+		TAILQ_INSERT_TAIL(&pool->full, slab, link);
+	}
+
+	pool->allocs++;
+	if (++pool->inuse > pool->peak)
+		pool->peak = pool->inuse;
+
+	memset(&obj[1], 0, pool->size);
+
+	return &obj[1];
+}
+
+/**
+ * pool_free - Return object to its pool
+ * @ptr: Pointer to object from pool_alloc()
+ *
+ * The object is put on the free list of its slab, in constant time.  A
+ * slab with no objects in use is released, unless it is the spare.
+ */
+void pool_free(void *ptr)
+{
+	struct pool_obj *obj;
+	struct slab *slab;
+	struct pool *pool;
+
+	if (!ptr)
+		return;
+
+	obj  = (struct pool_obj *)ptr - 1;
+	slab = obj->slab;
+	pool = slab->pool;
+
+	if (slab->used == pool->per_slab) {
+		TAILQ_REMOVE(&pool->full, slab, link);
+		TAILQ_INSERT_TAIL(&pool->partial, slab, link);
+	}
+
+	obj->next  = slab->free;
+	slab->free = obj;
+	slab->used--;
+	pool->inuse--;
+
+	if (slab->used)
+		return;
+
+	/* Keep spare last, to fill up partially used slabs first */
+	TAILQ_REMOVE(&pool->partial, slab, link);
+	if (pool->spare < POOL_SPARE) {
+		TAILQ_INSERT_TAIL(&pool->partial, slab, link);
+		pool->spare++;
+		return;
+	}
+
+	pool->slabs--;
+	pool->released++;
+	free(slab);
+}
+
+/**
+ * pool_stats - Get usage and recycle statistics of a pool
+ * @pool: Pointer to &struct pool
+ * @st:   Pointer to &struct init_pool, for the API
+ */
+void pool_stats(struct pool *pool, struct init_pool *st)
+{
+	strlcpy(st->name, pool->name, sizeof(st->name));
+	st->size     = pool->size;
+	st->per_slab = pool->per_slab;
+	st->slabs    = pool->slabs;
+	st->inuse    = pool->inuse;
+	st->peak     = pool->peak;
+	st->allocs   = pool->allocs;
+	st->recycled = pool->recycled;
+	st->released = pool->released;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
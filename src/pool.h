@@ -0,0 +1,78 @@
+/* Object pool, slab allocator with free lists
+ *
+ * Copyright (c) 2020  Joachim Nilsson <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_POOL_H_
+#define FINIT_POOL_H_
+
+#include <stddef.h>
+#include <lite/queue.h>		/* BSD sys/queue.h API */
+
+#include "finit.h"		/* struct init_pool */
+
+struct slab;
+TAILQ_HEAD(slab_head, slab);
+
+/*
+ * Pool of fixed size objects, allocated in slabs of @per_slab objects.
+ * Freed objects are recycled from a per-slab free list, and a slab is
+ * returned to the heap when all its objects are free, but one empty
+ * slab is kept as a spare to not thrash on bursts.
+ */
+struct pool {
+	const char      *name;
+	size_t           size;		/* Object size */
+	int              per_slab;	/* Objects per slab */
+
+	struct slab_head partial;	/* Slabs with free objects */
+	struct slab_head full;		/* Slabs without free objects */
+	int              spare;		/* Number of empty slabs kept */
+
+	/* Statistics */
+	int              slabs;
+	int              inuse;
+	int              peak;
+	unsigned int     allocs;
+	unsigned int     recycled;	/* allocs from free list */
+	unsigned int     released;	/* slabs returned to heap */
+};
+
+#define POOL_INITIALIZER(pool, nm, sz, num) {			\
+		.name     = nm,					\
+		.size     = sz,					\
+		.per_slab = num,				\
+		.partial  = TAILQ_HEAD_INITIALIZER(pool.partial),	\
+		.full     = TAILQ_HEAD_INITIALIZER(pool.full),	\
+	}
+
+void *pool_alloc (struct pool *pool);
+void  pool_free  (void *ptr);
+void  pool_stats (struct pool *pool, struct init_pool *st);
+
+#endif /* FINIT_POOL_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -33,7 +33,7 @@ int       api_exit         (void);
 
 int       client           (int argc, char *argv[]);
 
-void      service_monitor  (pid_t lost);
+void      service_monitor  (pid_t lost, int status);
 
 const char *plugin_hook_str(hook_point_t no);
 int       plugin_exists    (hook_point_t no);
@@ -0,0 +1,389 @@
+/* Cache of resolved service credentials and executable paths
+ *
+ * Copyright (c) 2020  Joachim Nilsson <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <limits.h>		/* NAME_MAX, PATH_MAX */
+#include <paths.h>
+#include <pwd.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <lite/lite.h>
+#include <lite/queue.h>		/* BSD sys/queue.h API */
+
+#include "finit.h"
+#include "helpers.h"
+#include "resolve.h"
+
+/*
+ * Looking up the path of a command walks $PATH with stat(), and a user
+ * or group lookup goes through NSS.  Both are done once and cached here,
+ * until an inotify event for /etc/passwd, /etc/group, or the directory
+ * of a cached command says otherwise.  Any mount, or unmount, of a file
+ * system may hide or reveal commands, so /proc/self/mounts is watched
+ * as well.  On any change, all entries of that kind are dropped.
+ */
+#define RESOLVE_HASH_SIZE 64
+#define RESOLVE_MAX_GROUPS 32
+
+struct path_entry {
+	TAILQ_ENTRY(path_entry) link;
+	char  *cmd;
+	char  *path;		/* NULL: not found */
+};
+
+struct cred_entry {
+	TAILQ_ENTRY(cred_entry) link;
+	char        *user;
+	char        *group;
+	struct cred  cred;
+};
+
+static TAILQ_HEAD(, path_entry) path_idx[RESOLVE_HASH_SIZE];
+static TAILQ_HEAD(, cred_entry) cred_idx[RESOLVE_HASH_SIZE];
+
+static uev_t inotify_watcher;
+static uev_t mounts_watcher;
+static int   etc_wd = -1;
+
+
+static unsigned int strhash(const char *str)
+{
+	unsigned int hash = 5381;
+
+	while (*str)
+		hash = hash * 33 + (unsigned char)*str++;
+
+	return hash % RESOLVE_HASH_SIZE;
+}
+
+static void path_flush(void)
+{
+	struct path_entry *entry, *tmp;
+
+	_d("Dropping cached command paths");
+	for (int i = 0; i < RESOLVE_HASH_SIZE; i++) {
+		TAILQ_FOREACH_SAFE(entry, &path_idx[i], link, tmp) {
+			TAILQ_REMOVE(&path_idx[i], entry, link);
+			free(entry->path);
+			free(entry->cmd);
+			free(entry);
+		}
+	}
+}
+
+static void cred_flush(void)
+{
+	struct cred_entry *entry, *tmp;
+
+	_d("Dropping cached user and group credentials");
+	for (int i = 0; i < RESOLVE_HASH_SIZE; i++) {
+		TAILQ_FOREACH_SAFE(entry, &cred_idx[i], link, tmp) {
+			TAILQ_REMOVE(&cred_idx[i], entry, link);
+			free(entry->cred.groups);
+			free(entry->cred.home);
+			free(entry->group);
+			free(entry->user);
+			free(entry);
+		}
+	}
+}
+
+/* Watch directory of @path for changes, returns -1 if not possible */
+static int watch_dir(const char *path)
+{
+	char dir[PATH_MAX], *ptr;
+
+	if (inotify_watcher.fd < 0)
+		return -1;
+
+	strlcpy(dir, path, sizeof(dir));
+	ptr = strrchr(dir, '/');
+	if (!ptr)
+		return -1;
+	if (ptr == dir)
+		ptr++;
+	*ptr = 0;
+
+	return inotify_add_watch(inotify_watcher.fd, dir, IN_MASK_ADD | IN_CREATE |
+				 IN_DELETE | IN_ATTRIB | IN_MOVE | IN_CLOSE_WRITE);
+}
+
+/* Commands without a path depend on all directories in $PATH */
+static int watch_cmd(const char *cmd, const char *path)
+{
+	char *env, *dirs, *dir, buf[PATH_MAX];
+	int rc = 0;
+
+	if (strchr(cmd, '/'))
+		return watch_dir(cmd);
+
+	env = getenv("PATH");
+	dirs = strdup(env ? env : _PATH_STDPATH);
+	if (!dirs)
+		return -1;
+
+	for (env = dirs; (dir = strsep(&env, ":")); ) {
+		snprintf(buf, sizeof(buf), "%s/%s", dir, cmd);
+		if (watch_dir(buf) < 0)
+			rc = -1;
+
+		/* Directories after the one @cmd was found in cannot matter */
+		if (path && !strcmp(buf, path))
+			break;
+	}
+	free(dirs);
+
+	return rc;
+}
+
+/**
+ * resolve_path - find full path of a command, like which()
+ * @cmd: Command, with or without a path
+ *
+ * Returns:
+ * Cached path to the executable, or %NULL if not found.
+ */
+const char *resolve_path(const char *cmd)
+{
+	struct path_entry *entry;
+	unsigned int hash;
+	char *path;
+
+	if (!cmd || !cmd[0])
+		return NULL;
+
+	hash = strhash(cmd);
+	TAILQ_FOREACH(entry, &path_idx[hash], link) {
+		if (!strcmp(entry->cmd, cmd))
+			return entry->path;
+	}
+
+	path = which(cmd);
+
+	/* Not found is only cached if we get to know when it appears */
+	if (watch_cmd(cmd, path) < 0) {
+		if (path) {
+			static char buf[PATH_MAX];
+
+			strlcpy(buf, path, sizeof(buf));
+			free(path);
+			return buf;
+		}
+		return NULL;
+	}
+
+	entry = malloc(sizeof(*entry));
+	if (!entry || !(entry->cmd = strdup(cmd))) {
+		free(entry);
+		free(path);
+		return NULL;
+	}
+	entry->path = path;
+	TAILQ_INSERT_HEAD(&path_idx[hash], entry, link);
+
+	return entry->path;
+}
+
+static void cred_lookup(struct cred *cred, const char *user, const char *group)
+{
+	char *home = NULL;
+
+	cred->uid = getuser((char *)user, &home);
+	cred->gid = getgroup((char *)group);
+	cred->home = home ? strdup(home) : NULL;
+
+#ifndef ENABLE_STATIC
+	if (cred->uid >= 0) {
+		gid_t groups[RESOLVE_MAX_GROUPS];
+		struct passwd *pw;
+		int num = RESOLVE_MAX_GROUPS;
+
+		pw = getpwnam(user);
+		if (!pw)
+			return;
+
+		if (getgrouplist(user, cred->gid >= 0 ? (gid_t)cred->gid : pw->pw_gid, groups, &num) < 0) {
+			logit(LOG_WARNING, "%s: more than %d supplementary groups, skipping rest",
+			      user, RESOLVE_MAX_GROUPS);
+			num = RESOLVE_MAX_GROUPS;
+		}
+
+		cred->groups = malloc(num * sizeof(gid_t));
+		if (cred->groups) {
+			memcpy(cred->groups, groups, num * sizeof(gid_t));
+			cred->ngroups = num;
+		}
+	}
+#endif
+}
+
+/**
+ * resolve_cred - look up uid, gid, home and supplementary groups
+ * @user:  User name, may be empty
+ * @group: Group name, may be empty
+ *
+ * Returns:
+ * Cached credentials, uid and gid are -1 if not found.  Only valid
+ * until next return to the event loop.
+ */
+const struct cred *resolve_cred(const char *user, const char *group)
+{
+	static struct cred none = { .uid = -1, .gid = -1 };
+	struct cred_entry *entry;
+	unsigned int hash;
+
+	if (!user)
+		user = "";
+	if (!group)
+		group = "";
+
+	/* Without a watch on /etc, only the last lookup is kept */
+	if (etc_wd < 0)
+		cred_flush();
+
+	hash = strhash(user) ^ strhash(group);
+	TAILQ_FOREACH(entry, &cred_idx[hash], link) {
+		if (!strcmp(entry->user, user) && !strcmp(entry->group, group))
+			return &entry->cred;
+	}
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return &none;
+
+	entry->user  = strdup(user);
+	entry->group = strdup(group);
+	if (!entry->user || !entry->group) {
+		free(entry->user);
+		free(entry);
+		return &none;
+	}
+
+	cred_lookup(&entry->cred, user, group);
+	TAILQ_INSERT_HEAD(&cred_idx[hash], entry, link);
+
+	return &entry->cred;
+}
+
+static void inotify_cb(uev_t *w, void *arg, int events)
+{
+	char ev_buf[8 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+	struct inotify_event *ev;
+	int creds = 0, paths = 0;
+	ssize_t sz, len;
+
+	while ((sz = read(w->fd, ev_buf, sizeof(ev_buf))) > 0) {
+		for (ev = (void *)ev_buf; sz >= (ssize_t)sizeof(*ev);
+		     len = sizeof(*ev) + ev->len, ev = (void *)ev + len, sz -= len) {
+			if (ev->mask & IN_Q_OVERFLOW) {
+				creds = paths = 1;
+				continue;
+			}
+
+			/* Commands may be in /etc, e.g. /etc/init.d/foo */
+			if (ev->wd == etc_wd && ev->len &&
+			    (!strcmp(ev->name, "passwd") || !strcmp(ev->name, "group")))
+				creds = 1;
+			else
+				paths = 1;
+		}
+	}
+
+	if (creds)
+		cred_flush();
+	if (paths)
+		path_flush();
+}
+
+/* (Re)add watch of /etc, it may have been replaced by a mount */
+static void watch_etc(void)
+{
+	if (etc_wd >= 0)
+		inotify_rm_watch(inotify_watcher.fd, etc_wd);
+
+	etc_wd = inotify_add_watch(inotify_watcher.fd, "/etc", IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+	if (etc_wd < 0)
+		_pe("Failed watching /etc for changes to users and groups");
+}
+
+static void mounts_cb(uev_t *w, void *arg, int events)
+{
+	/* A change of mounts is signaled as POLLERR | POLLPRI */
+	if (UEV_ERROR == events)
+		uev_io_set(w, w->fd, UEV_PRI);
+
+	watch_etc();
+	cred_flush();
+	path_flush();
+}
+
+/**
+ * resolve_init - set up cache and inotify watchers
+ * @ctx: Main event loop
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero if changes cannot be monitored.  Nothing is
+ * cached then, except for the last credentials looked up.
+ */
+int resolve_init(uev_ctx_t *ctx)
+{
+	int fd;
+
+	for (int i = 0; i < RESOLVE_HASH_SIZE; i++) {
+		TAILQ_INIT(&path_idx[i]);
+		TAILQ_INIT(&cred_idx[i]);
+	}
+
+	inotify_watcher.fd = -1;
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		_pe("Failed creating inotify descriptor");
+		return 1;
+	}
+
+	if (uev_io_init(ctx, &inotify_watcher, inotify_cb, NULL, fd, UEV_READ)) {
+		_pe("Failed setting up inotify watcher");
+		inotify_watcher.fd = -1;
+		close(fd);
+		return 1;
+	}
+	watch_etc();
+
+	fd = open("/proc/self/mounts", O_RDONLY | O_CLOEXEC);
+	if (fd >= 0 && uev_io_init(ctx, &mounts_watcher, mounts_cb, NULL, fd, UEV_PRI)) {
+		_pe("Failed setting up watcher of mounts");
+		close(fd);
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
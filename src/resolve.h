@@ -0,0 +1,53 @@
+/* Cache of resolved service credentials and executable paths
+ *
+ * Copyright (c) 2020  Joachim Nilsson <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_RESOLVE_H_
+#define FINIT_RESOLVE_H_
+
+#include <sys/types.h>
+#include <uev/uev.h>
+
+/*
+ * Credentials of a user and group, numeric ids are -1 if not found.
+ * Only valid until the next return to the event loop.
+ */
+struct cred {
+	int    uid;
+	int    gid;
+	char  *home;
+	int    ngroups;		/* Supplementary groups */
+	gid_t *groups;
+};
+
+int                resolve_init (uev_ctx_t *ctx);
+const char        *resolve_path (const char *cmd);
+const struct cred *resolve_cred (const char *user, const char *group);
+
+#endif /* FINIT_RESOLVE_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
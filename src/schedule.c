@@ -25,40 +25,15 @@
 #include "finit.h"
 #include "schedule.h"
 
-#define SC_INIT 0x494E4954	/* "INIT", see ascii(7) */
-
-/*
- * libuEv callback wrapper
- */
-static void cb(uev_t *w, void *arg, int events)
-{
-	struct wq *work = (struct wq *)arg;
-
-	if (UEV_ERROR == events) {
-		uev_timer_start(w);
-		return;
-	}
-
-	work->cb(work);
-}
-
 /*
  * Place work on event queue
  */
 int schedule_work(struct wq *work)
 {
-	int msec;
-
 	if (!work)
 		return errno = EINVAL;
 
-	msec = work->delay;
-	if (work->init != SC_INIT) {
-		work->init = SC_INIT;
-		return uev_timer_init(ctx, &work->watcher, cb, work, msec, 0);
-	}
-
-	return uev_timer_set(&work->watcher, msec, 0);
+	return tmo_start(&work->tmo, work->delay, work->cb, work);
 }
 
 /**
@@ -24,9 +24,10 @@
 #ifndef FINIT_SCHEDULE_H_
 #define FINIT_SCHEDULE_H_
 
+#include "tmo.h"
+
 struct wq {
-	uev_t   watcher;
-	int     init;
+	struct tmo tmo;
 	int     delay;		/* msec delay before starting work */
 	void  (*cb)(void *);
 	void   *arg;
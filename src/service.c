@@ -24,9 +24,12 @@
 
 #include "config.h"		/* Generated by configure script */
 
+#include <alloca.h>
 #include <ctype.h>		/* isblank() */
+#include <limits.h>		/* PATH_MAX */
 #include <sched.h>		/* sched_yield() */
 #include <string.h>
+#include <grp.h>			/* setgroups() */
 #include <sys/resource.h>
 #include <sys/wait.h>
 #include <net/if.h>
@@ -40,9 +43,11 @@
 #include "inetd.h"
 #include "pid.h"
 #include "private.h"
+#include "resolve.h"
 #include "sig.h"
 #include "service.h"
 #include "sm.h"
+#include "svclog.h"
 #include "tty.h"
 #include "util.h"
 #include "utmp-api.h"
@@ -54,21 +59,37 @@ static struct wq work = {
 	.cb = service_worker,
 };
 
+/*
+ * Run jobs are started asynchronously, but services declared after a
+ * run job must still wait for it to complete, unless they have their
+ * own conditions.  This is the sequencing barrier: the job# of the
+ * first run job still in progress.
+ */
+static int run_active;
+static int run_barrier;
+
+/*
+ * Bootstrap waits for the run/task marked pending, and is resumed with
+ * bootstrap_done when the last one completes, see service_completed()
+ */
+static int        bootstrap_pending;
+static struct wq *bootstrap_done;
+
 static void svc_set_state(svc_t *svc, svc_state_t new);
+static void service_enqueue_deps(svc_t *svc);
+static int  bootstrap_waits_for(svc_t *svc);
+static void bootstrap_set(svc_t *svc, int pending);
 
 /**
- * service_timeout_cb - libuev callback wrapper for service timeouts
- * @w:      Watcher
- * @arg:    Callback argument, from init
- * @events: Error, or ready to read/write (N/A for relative timers)
+ * service_timeout_cb - Timer wheel callback wrapper for service timeouts
+ * @arg: Callback argument, the &svc_t
  *
  * Run callback registered when calling service_timeout_after().
  */
-static void service_timeout_cb(uev_t *w, void *arg, int events)
+static void service_timeout_cb(void *arg)
 {
 	svc_t *svc = arg;
 
-	/* Ignore any UEV_ERROR, we're a one-shot cb so just run it. */
 	if (svc->timer_cb)
 		svc->timer_cb(svc);
 }
@@ -91,7 +112,7 @@ static int service_timeout_after(svc_t *svc, int timeout, void (*cb)(svc_t *svc)
 		return -EBUSY;
 
 	svc->timer_cb = cb;
-	return uev_timer_init(ctx, &svc->timer, service_timeout_cb, svc, timeout, 0);
+	return tmo_start(&svc->timer, timeout, service_timeout_cb, svc);
 }
 
 /**
@@ -105,15 +126,13 @@ static int service_timeout_after(svc_t *svc, int timeout, void (*cb)(svc_t *svc)
  */
 static int service_timeout_cancel(svc_t *svc)
 {
-	int err;
-
 	if (!svc->timer_cb)
 		return 0;
 
-	err = uev_timer_stop(&svc->timer);
+	tmo_stop(&svc->timer);
 	svc->timer_cb = NULL;
 
-	return err;
+	return 0;
 }
 
 static void redirect_null(void)
@@ -128,6 +147,116 @@ static void redirect_null(void)
 	}
 }
 
+/*
+ * Internal inetd services run code in the child, those still fork.
+ */
+static int service_can_spawn(svc_t *svc)
+{
+	if (svc->inetd.cmd)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Fast start of service, see exec_spawn().  Everything the fork() path
+ * in service_start() does in the child is prepared here instead.
+ */
+static pid_t service_spawn(svc_t *svc, const char *path, const struct cred *cred, int logfd)
+{
+	struct spawn sp = {
+		.rlimit  = svc->rlimit,
+		.uid     = cred->uid,
+		.gid     = cred->gid,
+		.ngroups = cred->ngroups,
+		.groups  = cred->groups,
+		.fd      = { -1, -1, -1 },
+	};
+	char *arg, **args, **env, *home = cred->home;
+	char *cmdline, homeenv[PATH_MAX + 6];
+	int i, num, argc = 0, fd = -1;
+	pid_t pid;
+
+	svc_foreach_arg(svc, arg)
+		argc++;
+	args = alloca((argc + 1) * sizeof(char *));
+	for (i = 0, arg = svc->args; i < argc; arg += strlen(arg) + 1)
+		args[i++] = arg;
+	args[i] = NULL;
+
+	if (svc->shell) {
+		size_t len = svc_args_size(svc->args);
+
+		cmdline = alloca(len);
+		exec_runtask_cmdline(svc->cmd, args, cmdline, len);
+		_d("Calling %s %s", _PATH_BSHELL, cmdline);
+
+		args = alloca(4 * sizeof(char *));
+		args[0] = "sh";
+		args[1] = "-c";
+		args[2] = cmdline;
+		args[3] = NULL;
+		sp.path = _PATH_BSHELL;
+	} else {
+		sp.path = path;
+	}
+	sp.argv = args;
+
+	/* Set default path for regular users, and $HOME */
+	for (num = 0; environ[num]; num++)
+		;
+	env = alloca((num + 3) * sizeof(char *));
+	for (i = 0, num = 0; environ[i]; i++) {
+		if (sp.uid > 0 && string_match(environ[i], "PATH="))
+			continue;
+		if (sp.uid >= 0 && home && string_match(environ[i], "HOME="))
+			continue;
+		env[num++] = environ[i];
+	}
+	if (sp.uid > 0)
+		env[num++] = "PATH=" _PATH_DEFPATH;
+	if (sp.uid >= 0 && home) {
+		snprintf(homeenv, sizeof(homeenv), "HOME=%s", home);
+		env[num++] = homeenv;
+		sp.cwd = home;
+	}
+	env[num] = NULL;
+	sp.envp = env;
+
+	/* Redirect inetd socket to stdin for connection */
+#ifdef INETD_ENABLED
+	if (svc_is_inetd_conn(svc)) {
+		for (i = 0; i < 3; i++)
+			sp.fd[i] = svc->stdin_fd;
+	} else
+#endif
+	if (svc->log.enabled) {
+		if (svc->log.null)
+			fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+		else if (logfd >= 0)
+			sp.fd[1] = sp.fd[2] = logfd;
+	} else if (log_is_debug()) {
+		fd = open(CONSOLE, O_WRONLY | O_APPEND | O_CLOEXEC);
+	}
+#ifdef REDIRECT_OUTPUT
+	else
+		fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+#endif
+	if (fd >= 0)
+		sp.fd[1] = sp.fd[2] = fd;
+
+	pid = exec_spawn(&sp);
+	if (pid == -1)
+		_pe("Failed starting %s", svc->cmd);
+	else if (sp.err)
+		logit(LOG_ERR, "Failed starting %s: %s", svc->cmd, strerror(sp.err));
+
+	if (fd >= 0)
+		close(fd);
+
+	return pid;
+}
+
 static int is_norespawn(void)
 {
 	return  sig_stopped()            ||
@@ -140,11 +269,14 @@ static int is_norespawn(void)
  * @svc: Service to start
  *
  * Returns:
- * 0 if the service was successfully started. Non-zero otherwise.
+ * 0 if the service was successfully started. Non-zero otherwise, and
+ * -1 if a run job could not be forked, i.e., it is completed, failed.
  */
 static int service_start(svc_t *svc)
 {
-	int i, result = 0, do_progress = 1;
+	int i, result = 0, do_progress = 1, logfd = -1;
+	const struct cred *cred;
+	const char *path;
 	pid_t pid;
 	sigset_t nmask, omask;
 
@@ -156,7 +288,8 @@ static int service_start(svc_t *svc)
 		return 1;
 
 	/* Don't try and start service if it doesn't exist. */
-	if (!whichp(svc->cmd) && !svc->inetd.cmd) {
+	path = resolve_path(svc->cmd);
+	if (!path && !svc->inetd.cmd) {
 		print(1, "Service %s does not exist!", svc->cmd);
 		svc_missing(svc);
 		return 1;
@@ -167,7 +300,8 @@ static int service_start(svc_t *svc)
 		return inetd_start(&svc->inetd);
 #endif
 
-	if (!svc->desc[0])
+	/* Progress of run jobs is printed on completion */
+	if (!svc->desc[0] || svc->type == SVC_TYPE_RUN)
 		do_progress = 0;
 
 	if (do_progress) {
@@ -180,28 +314,34 @@ static int service_start(svc_t *svc)
 	/* Declare we're waiting for svc to create its pidfile */
 	svc_starting(svc);
 
+	/* Resolved in PID 1, so children only apply numeric ids */
+	cred = resolve_cred(svc->username, svc->group);
+
+	/* Output to syslog or a file is collected by Finit */
+	if (svc->log.enabled && !svc->log.null && !svc->log.console && !svc_is_inetd_conn(svc))
+		logfd = svclog_open(svc);
+
 	/* Block SIGCHLD while forking.  */
 	sigemptyset(&nmask);
 	sigaddset(&nmask, SIGCHLD);
 	sigprocmask(SIG_BLOCK, &nmask, &omask);
 
-	pid = fork();
+	if (service_can_spawn(svc))
+		pid = service_spawn(svc, path, cred, logfd);
+	else
+		pid = fork();
 	cgroup_service(svc->cmd, pid);
 
 	if (pid == 0) {
 		int status;
-		char *home = NULL;
-#ifdef ENABLE_STATIC
-		int uid = 0; /* XXX: Fix better warning that dropprivs is disabled. */
-		int gid = 0;
-#else
-		int uid = getuser(svc->username, &home);
-		int gid = getgroup(svc->group);
-#endif
-		char *args[MAX_NUM_SVC_ARGS];
+		char *home = cred->home;
+		int uid = cred->uid;
+		int gid = cred->gid;
+		char *arg, **args;
+		int argc = 0;
 
 		/* Set configured limits */
-		for (int i = 0; i < RLIMIT_NLIMITS; i++) {
+		for (int i = 0; svc->rlimit && i < RLIMIT_NLIMITS; i++) {
 			if (setrlimit(i, &svc->rlimit[i]) == -1)
 				logit(LOG_WARNING,
 				      "%s: rlimit: Failed setting %s",
@@ -209,6 +349,8 @@ static int service_start(svc_t *svc)
 		}
 
 		/* Set desired user+group */
+		if (cred->ngroups > 0)
+			setgroups(cred->ngroups, cred->groups);
 		if (gid >= 0)
 			setgid(gid);
 
@@ -225,8 +367,11 @@ static int service_start(svc_t *svc)
 		}
 
 		/* Serve copy of args to process in case it modifies them. */
-		for (i = 0; i < (MAX_NUM_SVC_ARGS - 1) && svc->args[i][0] != 0; i++)
-			args[i] = svc->args[i];
+		svc_foreach_arg(svc, arg)
+			argc++;
+		args = alloca((argc + 1) * sizeof(char *));
+		for (i = 0, arg = svc->args; i < argc; arg += strlen(arg) + 1)
+			args[i++] = arg;
 		args[i] = NULL;
 
 		/* Redirect inetd socket to stdin for connection */
@@ -240,8 +385,6 @@ static int service_start(svc_t *svc)
 #endif
 
 		if (svc->log.enabled) {
-			int fd;
-
 			if (svc->log.null) {
 				redirect_null();
 				goto logit_done;
@@ -250,60 +393,11 @@ static int service_start(svc_t *svc)
 				goto logit_done;
 			}
 
-			/*
-			 * Open PTY to connect to logger.  A pty isn't buffered
-			 * like a pipe, and it eats newlines so they aren't logged
-			 */
-			fd = posix_openpt(O_RDWR);
-			if (fd == -1) {
-				svc->log.enabled = 0;
-				goto logit_done;
-			}
-			if (grantpt(fd) == -1 || unlockpt(fd) == -1) {
-				close(fd);
-				svc->log.enabled = 0;
-				goto logit_done;
-			}
-
-			/* SIGCHLD is still blocked for grantpt() and fork() */
-			sigprocmask(SIG_BLOCK, &nmask, NULL);
-			pid = fork();
-			if (pid == 0) {
-				int fds;
-				char *tag  = basename(svc->cmd);
-				char *prio = "daemon.info";
-
-				fds = open(ptsname(fd), O_RDONLY);
-				close(fd);
-				if (fds == -1)
-					_exit(0);
-				dup2(fds, STDIN_FILENO);
-
-				/* Reset signals */
-				sig_unblock();
-
-				if (svc->log.file[0] == '/') {
-					char sz[20], num[3];
-
-					snprintf(sz, sizeof(sz), "%d", logfile_size_max);
-					snprintf(num, sizeof(num), "%d", logfile_count_max);
-
-					execlp("logit", "logit", "-f", svc->log.file, "-n", sz, "-r", num, NULL);
-					_exit(0);
-				}
-
-				if (svc->log.ident[0])
-					tag = svc->log.ident;
-				if (svc->log.prio[0])
-					prio = svc->log.prio;
-
-				execlp("logit", "logit", "-t", tag, "-p", prio, NULL);
-				_exit(0);
+			/* Collected by Finit, see svclog.c */
+			if (logfd >= 0) {
+				dup2(logfd, STDOUT_FILENO);
+				dup2(logfd, STDERR_FILENO);
 			}
-
-			dup2(fd, STDOUT_FILENO);
-			dup2(fd, STDERR_FILENO);
-			close(fd);
 		} else if (log_is_debug()) {
 			int fd;
 
@@ -324,10 +418,10 @@ static int service_start(svc_t *svc)
 
 		if (svc->inetd.cmd)
 			status = svc->inetd.cmd(svc->inetd.type);
-		else if (svc_is_runtask(svc))
+		else if (svc->shell)
 			status = exec_runtask(svc->cmd, args);
 		else
-			status = execv(svc->cmd, args);
+			status = execv(path, args);
 
 #ifdef INETD_ENABLED
 		if (svc_is_inetd_conn(svc)) {
@@ -336,36 +430,49 @@ static int service_start(svc_t *svc)
 				close(STDOUT_FILENO);
 				close(STDERR_FILENO);
 			}
-		} else
+		}
 #endif
-		if (svc->log.enabled && !svc->log.null)
-			waitpid(pid, NULL, 0);
 		_exit(status);
 	} else if (log_is_debug()) {
 		char buf[CMD_SIZE] = "";
+		char *arg;
 
-		for (i = 0; i < (MAX_NUM_SVC_ARGS - 1) && svc->args[i][0] != 0; i++) {
-			char arg[MAX_ARG_LEN + 1];
-
-			snprintf(arg, sizeof(arg), "%s ", svc->args[i]);
-			if (strlen(arg) < (sizeof(buf) - strlen(buf)))
+		svc_foreach_arg(svc, arg) {
+			if (strlen(arg) + 1 < (sizeof(buf) - strlen(buf))) {
 				strlcat(buf, arg, sizeof(buf));
+				strlcat(buf, " ", sizeof(buf));
+			}
 		}
 		_d("Starting %s: %s", svc->cmd, buf);
 	}
 
+	/* Write end of log pipe is now held by the service */
+	if (logfd >= 0)
+		close(logfd);
+
 	logit(LOG_CONSOLE | LOG_NOTICE, "Starting %s:%s, PID: %d",
 	      basename(svc->cmd), svc->id, pid);
 
-	svc->pid = pid;
+	svc_set_pid(svc, pid);
 	svc->start_time = jiffies();
 
 	switch (svc->type) {
 	case SVC_TYPE_RUN:
-		result = WEXITSTATUS(complete(svc->cmd, pid));
-		svc->start_time = svc->pid = 0;
-		svc->once++;
-		svc_set_state(svc, SVC_STOPPING_STATE);
+		/* Never collected by service_monitor(), completed, with error */
+		if (pid <= 0) {
+			svc_set_pid(svc, 0);
+			result = -1;
+			if (svc->desc[0]) {
+				print_desc("", svc->desc);
+				print_result(1);
+			}
+			break;
+		}
+
+		/* Collected by service_monitor(), see service_run_done() */
+		if (!run_active || svc->job < run_barrier)
+			run_barrier = svc->job;
+		run_active++;
 		break;
 
 	case SVC_TYPE_SERVICE:
@@ -390,6 +497,77 @@ static int service_start(svc_t *svc)
 	return result;
 }
 
+/*
+ * Recalculate the sequencing barrier, e.g. when a run job completes or
+ * is removed, and queue services held back by it, they are still in
+ * ready state.
+ */
+static void service_barrier_update(void)
+{
+	svc_t *svc, *iter = NULL;
+	int active = 0, barrier = 0;
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		if (svc->type != SVC_TYPE_RUN || svc->pid <= 0)
+			continue;
+
+		if (!active++ || svc->job < barrier)
+			barrier = svc->job;
+	}
+
+	if (active == run_active && barrier == run_barrier)
+		return;
+
+	run_active  = active;
+	run_barrier = barrier;
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		if (svc->state == SVC_READY_STATE)
+			service_enqueue(svc);
+	}
+}
+
+/*
+ * Services declared after a run job still in progress must wait for it
+ * to complete.  Services with conditions are ordered by those instead,
+ * so independent chains of run jobs and services can overlap.
+ */
+static int service_barrier(svc_t *svc)
+{
+	if (!run_active || svc->num_conds > 0 || svc_is_inetd_conn(svc))
+		return 0;
+
+	return svc->job > run_barrier;
+}
+
+/**
+ * service_run_completed - Have all run jobs in progress completed
+ *
+ * Returns:
+ * %TRUE(1) if no run job is in progress, otherwise %FALSE(0).
+ */
+int service_run_completed(void)
+{
+	return run_active == 0;
+}
+
+/* Run job collected, print its progress and update barrier */
+static void service_run_done(svc_t *svc, int status)
+{
+	int result = 1;
+
+	if (WIFEXITED(status))
+		result = WEXITSTATUS(status);
+
+	_d("Run job %s completed, exit code %d", svc->cmd, result);
+	if (svc->desc[0]) {
+		print_desc("", svc->desc);
+		print_result(result);
+	}
+
+	service_barrier_update();
+}
+
 /**
  * service_kill - Forcefully terminate a service
  * @param svc  Service to kill
@@ -497,7 +675,8 @@ static int service_restart(svc_t *svc)
 
 	if (svc->pid <= 1) {
 		_d("Bad PID %d for %s, SIGHUP", svc->pid, svc->cmd);
-		svc->start_time = svc->pid = 0;
+		svc->start_time = 0;
+		svc_set_pid(svc, 0);
 		return 1;
 	}
 
@@ -560,8 +739,28 @@ void service_runlevel(int newlevel)
 		networking(0);
 }
 
+/* Keeps previous value if @val is invalid */
+static void parse_log_num(const char *opt, char *val, int *num)
+{
+	const char *err = NULL;
+	int tmp;
+
+	if (!val) {
+		logit(LOG_WARNING, "log: missing %s value", opt);
+		return;
+	}
+
+	tmp = strtonum(val, 0, INT_MAX, &err);
+	if (err) {
+		logit(LOG_WARNING, "log: invalid %s value: %s", opt, val);
+		return;
+	}
+
+	*num = tmp;
+}
+
 /*
- * log:/path/to/logfile,priority:facility.level,tag:ident
+ * log:/path/to/logfile,sync:msec,priority:facility.level,tag:ident,rate:lines,bytes:bytes
  */
 static void parse_log(svc_t *svc, char *arg)
 {
@@ -576,11 +775,17 @@ static void parse_log(svc_t *svc, char *arg)
 		else if (!strcmp(tok, "console") || !strcmp(tok, "/dev/console"))
 			svc->log.console = 1;
 		else if (tok[0] == '/')
-			strlcpy(svc->log.file, tok, sizeof(svc->log.file));
+			svc_strset(&svc->log.file, tok);
 		else if (!strcmp(tok, "priority") || !strcmp(tok, "prio"))
 			strlcpy(svc->log.prio, strtok(NULL, ","), sizeof(svc->log.prio));
 		else if (!strcmp(tok, "tag") || !strcmp(tok, "identity") || !strcmp(tok, "ident"))
 			strlcpy(svc->log.ident, strtok(NULL, ","), sizeof(svc->log.ident));
+		else if (!strcmp(tok, "sync"))
+			parse_log_num(tok, strtok(NULL, ","), &svc->log.sync);
+		else if (!strcmp(tok, "rate"))
+			parse_log_num(tok, strtok(NULL, ","), &svc->log.rate);
+		else if (!strcmp(tok, "bytes"))
+			parse_log_num(tok, strtok(NULL, ","), &svc->log.bytes);
 
 		tok = strtok(NULL, ":=, ");
 	}
@@ -600,36 +805,73 @@ static void parse_name(svc_t *svc, char *arg)
 		name = name ? name + 1 : svc->cmd;
 	}
 
-	strlcpy(svc->name, name, sizeof(svc->name));
+	svc_strset(&svc->name, name);
 }
 
 /**
  * parse_cmdline_args - Update the command line args in the svc struct
  *
  * strtok internal pointer must be positioned at first command line arg
- * when this function is called.
+ * when this function is called.  The args are set with svc_argset(),
+ * replacing any args set earlier.
  *
  * Side effect: strtok internal pointer will be modified.
  */
 static void parse_cmdline_args(svc_t *svc, char *cmd)
 {
-	int i;
+	char **argv, **tmp, *arg;
+	int argc = 1, max = 16;
+
+	argv = malloc(max * sizeof(char *));
+	if (!argv)
+		goto fail;
+
+	argv[0] = cmd;
+	while ((arg = strtok(NULL, " "))) {
+		if (argc == max) {
+			max *= 2;
+			tmp = realloc(argv, max * sizeof(char *));
+			if (!tmp)
+				goto fail;
+			argv = tmp;
+		}
+		argv[argc++] = arg;
+	}
+
+	if (!svc_argset(svc, argv, argc)) {
+		free(argv);
+		return;
+	}
+fail:
+	_e("Out of memory, cannot set args of %s", svc->cmd);
+	free(argv);
+}
+
+
+/*
+ * Check if command line of a run/task needs a shell, i.e., has pipes,
+ * redirects, quotes, variables, globs, comments, or starts with an
+ * environment variable assignment.  Otherwise it is exec'ed directly.
+ */
+static int needs_shell(svc_t *svc)
+{
 	char *arg;
 
-	strlcpy(svc->args[0], cmd, sizeof(svc->args[0]));
+	if (strchr(svc->cmd, '='))
+		return 1;
 
-	/* Copy supplied args. Stop at MAX_NUM_SVC_ARGS-1 to allow the args
-	 * array to be zero-terminated. */
-	for (i=1; (arg = strtok(NULL, " ")) && i < (MAX_NUM_SVC_ARGS-1); i++)
-		strlcpy(svc->args[i], arg, sizeof(svc->args[0]));
+	svc_foreach_arg(svc, arg) {
+		if (strpbrk(arg, "|&;<>()$`\\\"'*?[\n"))
+			return 1;
+		if (arg[0] == '#' || arg[0] == '~')
+			return 1;
+		if (!strcmp(arg, "!") || !strcmp(arg, "{"))
+			return 1;
+	}
 
-	/* clear remaining args in case they were set earlier.
-	 * This also zero-terminates the args array.*/
-	for (; i < MAX_NUM_SVC_ARGS; i++)
-		svc->args[i][0] = 0;
+	return 0;
 }
 
-
 /**
  * service_register - Register service, task or run commands
  * @type:   %SVC_TYPE_SERVICE(0), %SVC_TYPE_TASK(1), %SVC_TYPE_RUN(2)
@@ -689,15 +931,16 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 	int forking = 0;
 #endif
 	int levels = 0;
-	int manual = 0;
+	int manual = 0, shell = 0;
 	char *line;
 	char *id = NULL;
 	char *username = NULL, *log = NULL, *pid = NULL;
 	char *service = NULL, *proto = NULL, *ifaces = NULL;
 	char *cmd, *desc, *runlevels = NULL, *cond = NULL;
 	char *name = NULL;
-	svc_t *svc;
+	svc_t *svc, *old = NULL;
 	plugin_t *plugin = NULL;
+	int changed = 0;
 
 	if (!cfg) {
 		_e("Invalid input argument");
@@ -757,6 +1000,8 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 			name = cmd;
 		else if (!strncasecmp(cmd, "manual:yes", 10))
 			manual = 1;
+		else if (!strncasecmp(cmd, "shell:yes", 9))
+			shell = 1;
 		else if (cmd[0] != '/' && strchr(cmd, '/'))
 			service = cmd;   /* inetd service/proto */
 		else
@@ -842,20 +1087,35 @@ recreate:
 		if (type == SVC_TYPE_SERVICE && manual) {
 			svc_stop(svc);
 		}
-	}
+	} else {
 #ifdef INETD_ENABLED
-	else {
 		if (svc_is_inetd(svc) && type != SVC_TYPE_INETD) {
 			_d("Service was previously inetd, deregistering ...");
 			inetd_del(&svc->inetd);
 			svc_del(svc);
 			goto recreate;
 		}
-	}
 #endif
+		/* Snapshot, to only mark as dirty if definition changed */
+		if (file && conf_changed(file))
+			old = svc_dup(svc);
+
+		/* Optional settings, may have been removed from .conf */
+		svc->log.enabled  = 0;
+		svc->log.null     = 0;
+		svc->log.console  = 0;
+		svc->log.prio[0]  = 0;
+		svc->log.ident[0] = 0;
+		svc->log.sync     = 0;
+		svc->log.rate     = 0;
+		svc->log.bytes    = 0;
+		svc_strset(&svc->log.file, NULL);
+		svc->username[0] = 0;
+		svc->group[0] = 0;
+	}
 
 	/* Always clear svc PID file, for now.  See TODO */
-	svc->pidfile[0] = 0;
+	svc_strset(&svc->pidfile, NULL);
 	/* Decode any optional pid:/optional/path/to/file.pid */
 	if (pid && svc_is_daemon(svc) && pid_file_parse(svc, pid))
 		_e("Invalid 'pid' argument to service: %s", pid);
@@ -877,17 +1137,20 @@ recreate:
 	} else
 		parse_cmdline_args(svc, cmd);
 
+	/* Only run/task with shell syntax, or shell:yes, use sh -c */
+	svc->shell = svc_is_runtask(svc) && (shell || needs_shell(svc));
+
 	svc->runlevels = levels;
 	_d("Service %s runlevel 0x%2x", svc->cmd, svc->runlevels);
 
-	conf_parse_cond(svc, cond);
+	changed = conf_parse_cond(svc, cond);
 
 	parse_name(svc, name);
 
 	if (log)
 		parse_log(svc, log);
 	if (desc)
-		strlcpy(svc->desc, desc, sizeof(svc->desc));
+		svc_strset(&svc->desc, desc);
 
 #ifdef INETD_ENABLED
 	if (svc_is_inetd(svc)) {
@@ -899,6 +1162,7 @@ recreate:
 		if (inetd_new(&svc->inetd, name, service, proto, forking, svc)) {
 			_e("Failed registering new inetd service %s/%s", service, proto);
 			free(line);
+			svc_free(old);
 			return svc_del(svc);
 		}
 
@@ -919,17 +1183,33 @@ recreate:
 	}
 #endif
 	/* Set configured limits */
-	memcpy(svc->rlimit, rlimit, sizeof(svc->rlimit));
+	svc_set_rlimit(svc, rlimit);
+
+	/* Name and PID file may have changed */
+	svc_rehash(svc);
 
-	/* New, recently modified or unchanged ... used on reload. */
-	if (file && conf_changed(file))
+	/* Track origin, for incremental reload */
+	svc_strset(&svc->file, file);
+
+	/*
+	 * New, recently modified or unchanged ... used on reload.  Only
+	 * mark as modified if the definition actually changed, e.g., not
+	 * on touch, comments, or runlevels, the latter are handled by the
+	 * state machine.
+	 */
+	if (file && conf_changed(file) && (!old || changed || svc_differs(old, svc)))
 		svc_mark_dirty(svc);
 	else
 		svc_mark_clean(svc);
+	svc_free(old);
 
 	if (!file)
 		svc->protect = 1;
 
+	/* Resolve path and credentials once, cached for service_start() */
+	resolve_path(svc->cmd);
+	resolve_cred(svc->username, svc->group);
+
 	/* Free duped line, from above */
 	free(line);
 	return 0;
@@ -975,10 +1255,13 @@ void service_unregister(svc_t *svc)
 		break;
 	}
 
+	bootstrap_set(svc, 0);
 	svc_del(svc);
+	if (svc->type == SVC_TYPE_RUN)
+		service_barrier_update();
 }
 
-void service_monitor(pid_t lost)
+void service_monitor(pid_t lost, int status)
 {
 	svc_t *svc;
 
@@ -1006,7 +1289,11 @@ void service_monitor(pid_t lost)
 	}
 
 	/* No longer running, update books. */
-	svc->start_time = svc->pid = 0;
+	svc->start_time = 0;
+	svc_set_pid(svc, 0);
+
+	if (svc->type == SVC_TYPE_RUN)
+		service_run_done(svc, status);
 
 	if (!service_step(svc)) {
 		/* Clean out any bootstrap tasks, they've had their time in the sun. */
@@ -1086,7 +1373,7 @@ restart:
 
 	_d("%20s(%4d): %8s %3sabled/%-7s cond:%-4s", svc->cmd, svc->pid,
 	   svc_status(svc), enabled ? "en" : "dis", svc_dirtystr(svc),
-	   condstr(cond_get_agg(svc->cond)));
+	   condstr(cond_get_svc(svc)));
 
 	switch (svc->state) {
 	case SVC_HALTED_STATE:
@@ -1132,14 +1419,25 @@ restart:
 	case SVC_READY_STATE:
 		if (!enabled) {
 			svc_set_state(svc, SVC_HALTED_STATE);
-		} else if (cond_get_agg(svc->cond) == COND_ON) {
+		} else if (cond_get_svc(svc) == COND_ON) {
 			/* wait until all processes have been stopped before continuing... */
 			if (sm_is_in_teardown(&sm))
 				break;
 
+			/* wait for any run job declared before us to complete */
+			if (service_barrier(svc))
+				break;
+
 			err = service_start(svc);
 			if (err) {
 				(*restart_cnt)++;
+
+				/* Failed run job, never started, done like any other */
+				if (err == -1 && svc->type == SVC_TYPE_RUN) {
+					svc->once++;
+					svc_set_state(svc, SVC_STOPPING_STATE);
+					break;
+				}
 				if (!svc_is_inetd_conn(svc))
 					break;
 			}
@@ -1183,7 +1481,7 @@ restart:
 			}
 		}
 
-		cond = cond_get_agg(svc->cond);
+		cond = cond_get_svc(svc);
 		switch (cond) {
 		case COND_OFF:
 			service_stop(svc);
@@ -1228,7 +1526,7 @@ restart:
 			break;
 		}
 
-		cond = cond_get_agg(svc->cond);
+		cond = cond_get_svc(svc);
 		switch (cond) {
 		case COND_ON:
 			kill(svc->pid, SIGCONT);
@@ -1261,10 +1559,14 @@ restart:
 
 	/*
 	 * When a run/task/service changes state, e.g. transitioning from
-	 * waiting to running, other services may need to change state too.
+	 * waiting to running, services depending on it may need to change
+	 * state too.
 	 */
 	if (changed)
-		schedule_work(&work);
+		service_enqueue_deps(svc);
+
+	if (bootstrap_done)
+		bootstrap_set(svc, bootstrap_waits_for(svc));
 
 	return 0;
 }
@@ -1274,9 +1576,51 @@ void service_step_all(int types)
 	svc_foreach_type(types, service_step);
 }
 
+/**
+ * service_enqueue - Step service later, from service_worker()
+ * @svc: Service to step
+ *
+ * Used when only a few services are affected by an event, instead of
+ * stepping all services with service_step_all().
+ */
+void service_enqueue(svc_t *svc)
+{
+	if (svc_enqueue(svc))
+		schedule_work(&work);
+}
+
+/* Queue all services depending on the svc/ condition of @svc */
+static void service_enqueue_deps(svc_t *svc)
+{
+	char cond[MAX_COND_LEN];
+	struct cond_ref *ref = NULL;
+	svc_t *dep;
+
+	mkcond(cond, sizeof(cond), svc->cmd);
+	for (dep = cond_dep_iterator(&ref, cond, 1); dep; dep = cond_dep_iterator(&ref, cond, 0))
+		service_enqueue(dep);
+}
+
+/*
+ * Drain the run queue.  Services queued while stepping, e.g. dependents
+ * of a service changing state, are handled in the next round, so as to
+ * not starve the event loop should the dependencies form a loop.
+ */
 void service_worker(void *unused)
 {
-	service_step_all(SVC_TYPE_SERVICE | SVC_TYPE_RUNTASK | SVC_TYPE_INETD);
+	svc_t *svc;
+	int num;
+
+	for (num = svc_queued(); num > 0; num--) {
+		svc = svc_dequeue();
+		if (!svc)
+			break;
+
+		service_step(svc);
+	}
+
+	if (svc_queued())
+		schedule_work(&work);
 }
 
 /**
@@ -1298,45 +1642,69 @@ void service_runtask_clean(void)
 	}
 }
 
+/*
+ * Should bootstrap wait for @svc?  All run/task in bootstrap must have
+ * run once, except those with %HOOK_SVC_UP or %HOOK_SYSTEM_UP in their
+ * condition, they cannot run until finalize().
+ */
+static int bootstrap_waits_for(svc_t *svc)
+{
+	if (!svc_is_runtask(svc) || !svc_enabled(svc) || svc->once)
+		return 0;
+
+	if (strstr(svc->cond, plugin_hook_str(HOOK_SVC_UP)) ||
+	    strstr(svc->cond, plugin_hook_str(HOOK_SYSTEM_UP)))
+		return 0;
+
+	return 1;
+}
+
+/* Update the set of run/task bootstrap waits for, when @svc changes */
+static void bootstrap_set(svc_t *svc, int pending)
+{
+	if (!bootstrap_done || svc->pending == pending)
+		return;
+
+	svc->pending = pending;
+	if (pending) {
+		bootstrap_pending++;
+		return;
+	}
+
+	_d("%s has completed, %d left ...", svc->cmd, bootstrap_pending - 1);
+	if (--bootstrap_pending == 0) {
+		schedule_work(bootstrap_done);
+		bootstrap_done = NULL;
+	}
+}
+
 /**
- * service_completed - Have run/task completed in current runlevel
- *
- * This function checks if all run/task have run once in the current
- * runlevel.  E.g., at bootstrap we must wait for these scripts or
- * programs to complete their run before switching to the configured
- * runlevel.
+ * service_completed - Schedule work when all bootstrap run/task are done
+ * @work: Work to schedule, or %NULL to stop waiting
  *
- * All tasks with %HOOK_SVC_UP, %HOOK_SYSTEM_UP set in their condition
- * mask are skipped.  These tasks cannot run until finalize()
- *
- * Returns:
- * %TRUE(1) or %FALSE(0)
+ * Finds all run/task that must run once before bootstrap can finish.
+ * The set is updated when they are stepped, or removed, and @work is
+ * scheduled as soon as it is empty, or directly if it already is.
  */
-int service_completed(void)
+void service_completed(struct wq *work)
 {
 	svc_t *svc, *iter = NULL;
 
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
-		if (!svc_is_runtask(svc))
-			continue;
-
-		if (!svc_enabled(svc))
-			continue;
+	bootstrap_done    = work;
+	bootstrap_pending = 0;
 
-		if (strstr(svc->cond, plugin_hook_str(HOOK_SVC_UP)) ||
-		    strstr(svc->cond, plugin_hook_str(HOOK_SYSTEM_UP))) {
-			_d("Skipping %s(%s), post-strap hook", svc->desc, svc->cmd);
-			continue;
-		}
-
-		if (!svc->once) {
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		svc->pending = 0;
+		if (work && bootstrap_waits_for(svc)) {
 			_d("%s has not yet completed ...", svc->cmd);
-			return 0;
+			bootstrap_set(svc, 1);
 		}
-		_d("%s has completed ...", svc->cmd);
 	}
 
-	return 1;
+	if (work && !bootstrap_pending) {
+		schedule_work(work);
+		bootstrap_done = NULL;
+	}
 }
 
 /**
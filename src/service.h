@@ -27,6 +27,8 @@
 
 #include "svc.h"
 
+struct wq;
+
 void	  service_runlevel	 (int newlevel);
 int	  service_register	 (int type, char *line, struct rlimit rlimit[], char *file);
 void      service_unregister     (svc_t *svc);
@@ -36,9 +38,11 @@ void      service_reload_dynamic (void);
 
 int       service_step           (svc_t *svc);
 void      service_step_all       (int types);
+void      service_enqueue        (svc_t *svc);
 void      service_worker         (void *unused);
 
-int       service_completed      (void);
+void      service_completed      (struct wq *work);
+int       service_run_completed  (void);
 
 #endif	/* FINIT_SERVICE_H_ */
 
@@ -150,6 +150,8 @@ void do_kill(int signo)
 
 void do_shutdown(shutop_t op)
 {
+	/* Write any queued progress, from here on we block anyway */
+	print_exit();
 	touch(SYNC_SHUTDOWN);
 
 	if (sdown)
@@ -316,6 +318,7 @@ static void sigterm_cb(uev_t *w, void *arg, int events)
 static void sigchld_cb(uev_t *w, void *arg, int events)
 {
 	pid_t pid;
+	int status;
 
 	if (UEV_ERROR == events) {
 		_e("Unrecoverable error in signal watcher");
@@ -324,10 +327,12 @@ static void sigchld_cb(uev_t *w, void *arg, int events)
 
 	/* Reap all the children! */
 	do {
-		pid = waitpid(-1, NULL, WNOHANG);
+		pid = waitpid(-1, &status, WNOHANG);
 		if (pid > 0) {
 			_d("Collected child %d", pid);
-			service_monitor(pid);
+			if (run_reap(pid, status))
+				continue;
+			service_monitor(pid, status);
 		}
 	} while (pid > 0);
 }
@@ -67,6 +67,9 @@ static char *sm_status(sm_state_t state)
 	case SM_RELOAD_WAIT_STATE:
 		return "reload/wait";
 
+	case SM_SHUTDOWN_WAIT_STATE:
+		return "shutdown/wait";
+
 	default:
 		return "unknown";
 	}
@@ -158,7 +161,7 @@ restart:
 
 		/* Make sure to (re)load all *.conf in /etc/finit.d/ */
 		if (conf_any_change())
-			conf_reload();
+			conf_reload(0);
 
 		/* Reset once flag of runtasks */
 		service_runtask_clean();
@@ -199,8 +202,7 @@ restart:
 		 *  tears ... in ... rain."
 		 */
 		if (runlevel == 0 || runlevel == 6) {
-			do_shutdown(halt);
-			sm->state = SM_RUNNING_STATE;
+			sm->state = SM_SHUTDOWN_WAIT_STATE;
 			break;
 		}
 
@@ -211,9 +213,23 @@ restart:
 		sm->state = SM_RUNNING_STATE;
 		break;
 
+	case SM_SHUTDOWN_WAIT_STATE:
+		/*
+		 * Run jobs are asynchronous, wait for them to complete,
+		 * we get here again from service_monitor() as they do.
+		 */
+		if (!service_run_completed()) {
+			_d("Waiting for run jobs to complete before shutdown ...");
+			break;
+		}
+
+		do_shutdown(halt);
+		sm->state = SM_RUNNING_STATE;
+		break;
+
 	case SM_RELOAD_CHANGE_STATE:
-		/* First reload all *.conf in /etc/finit.d/ */
-		conf_reload();
+		/* First reload all changed *.conf in /etc/finit.d/ */
+		conf_reload(0);
 
 		/*
 		 * Then, mark all affected service conditions as in-flux and
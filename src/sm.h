@@ -31,6 +31,7 @@ typedef enum {
 	SM_RUNLEVEL_WAIT_STATE,   /* Waiting for all stopped runlevel processes to be halted */
 	SM_RELOAD_CHANGE_STATE,   /* A reload event has occured */
 	SM_RELOAD_WAIT_STATE,     /* Waiting for all stopped reload processes to be halted */
+	SM_SHUTDOWN_WAIT_STATE,   /* Waiting for run jobs to complete before shutdown */
 } sm_state_t;
 
 typedef struct sm {
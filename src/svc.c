@@ -24,6 +24,7 @@
 
 #include <err.h>
 #include <ctype.h>		/* isdigit() */
+#include <stddef.h>		/* offsetof() */
 #include <time.h>
 #include <stdlib.h>
 #include <strings.h>
@@ -37,11 +38,298 @@
 #include "util.h"
 #include "cond.h"
 #include "schedule.h"
+#include "svclog.h"
+#include "pool.h"
+
+/*
+ * Number of buckets in each lookup index, must be a power of two.  The
+ * svc_list remains the authoritative list of services, the indexes are
+ * only there to avoid linear scans in the most common lookups.
+ */
+#define SVC_HASH_SIZE    256
+#define SVC_BUCKET(hash) ((hash) & (SVC_HASH_SIZE - 1))
+
+/* svc->indexed flags, for optional indexes */
+#define SVC_IDX_NAME     0x01
+#define SVC_IDX_PIDFILE  0x02
+
+TAILQ_HEAD(svc_head, svc);
+
+/*
+ * Interned strings, argv[], and rlimits.  Shared between services and
+ * reference counted, most services use the same limits and log setup,
+ * and inetd connections share everything with their inetd service.
+ */
+struct str {
+	TAILQ_ENTRY(str) link;
+	unsigned int     hash;
+	int              refcnt;
+	size_t           len;
+	char             data[] __attribute__ ((aligned));
+};
+
+TAILQ_HEAD(str_head, str);
 
 /* Each svc_t needs a unique job# */
 static int jobcounter = 1;
-static TAILQ_HEAD(, svc) svc_list = TAILQ_HEAD_INITIALIZER(svc_list);
-static TAILQ_HEAD(, svc) gc_list  = TAILQ_HEAD_INITIALIZER(gc_list);
+static struct svc_head svc_list = TAILQ_HEAD_INITIALIZER(svc_list);
+
+/* Object pools, inetd connections come and go in bursts */
+static struct pool svc_pool  = POOL_INITIALIZER(svc_pool,  "svc",  sizeof(svc_t), 16);
+static struct pool conn_pool = POOL_INITIALIZER(conn_pool, "conn", sizeof(svc_t), 16);
+static struct svc_head gc_list  = TAILQ_HEAD_INITIALIZER(gc_list);
+static struct svc_head run_queue = TAILQ_HEAD_INITIALIZER(run_queue);
+static int run_queue_len = 0;
+
+static struct svc_head pid_idx[SVC_HASH_SIZE];     /* pid      --> svc */
+static struct svc_head cmd_idx[SVC_HASH_SIZE];     /* cmd:id   --> svc */
+static struct svc_head job_idx[SVC_HASH_SIZE];     /* job      --> instances */
+static struct svc_head name_idx[SVC_HASH_SIZE];    /* name:id  --> svc */
+static struct svc_head pidfile_idx[SVC_HASH_SIZE]; /* pidfile  --> svc */
+static struct str_head str_idx[SVC_HASH_SIZE];     /* interned strings */
+static char str_empty[2];			   /* "" and empty argv[] */
+
+/* djb2 by Dan Bernstein */
+static unsigned int strhash(const char *str)
+{
+	unsigned int hash = 5381;
+
+	while (*str)
+		hash = ((hash << 5) + hash) + (unsigned char)*str++;
+
+	return hash;
+}
+
+/* djb2, for interned data which may contain NUL, e.g. argv[] */
+static unsigned int memhash(const char *buf, size_t len)
+{
+	unsigned int hash = 5381;
+
+	while (len--)
+		hash = ((hash << 5) + hash) + (unsigned char)*buf++;
+
+	return hash;
+}
+
+static void index_init(void)
+{
+	static int done = 0;
+
+	if (done)
+		return;
+
+	for (int i = 0; i < SVC_HASH_SIZE; i++) {
+		TAILQ_INIT(&pid_idx[i]);
+		TAILQ_INIT(&cmd_idx[i]);
+		TAILQ_INIT(&job_idx[i]);
+		TAILQ_INIT(&name_idx[i]);
+		TAILQ_INIT(&pidfile_idx[i]);
+		TAILQ_INIT(&str_idx[i]);
+	}
+	done = 1;
+}
+
+static void index_add(svc_t *svc)
+{
+	TAILQ_INSERT_TAIL(&cmd_idx[SVC_BUCKET(strhash(svc->cmd))], svc, cmd_link);
+	TAILQ_INSERT_TAIL(&job_idx[SVC_BUCKET(svc->job)], svc, job_link);
+	if (svc->pid > 0)
+		TAILQ_INSERT_TAIL(&pid_idx[SVC_BUCKET(svc->pid)], svc, pid_link);
+
+	svc_rehash(svc);
+}
+
+static void index_del(svc_t *svc)
+{
+	TAILQ_REMOVE(&cmd_idx[SVC_BUCKET(strhash(svc->cmd))], svc, cmd_link);
+	TAILQ_REMOVE(&job_idx[SVC_BUCKET(svc->job)], svc, job_link);
+	if (svc->pid > 0)
+		TAILQ_REMOVE(&pid_idx[SVC_BUCKET(svc->pid)], svc, pid_link);
+
+	if (svc->indexed & SVC_IDX_NAME)
+		TAILQ_REMOVE(&name_idx[SVC_BUCKET(svc->name_hash)], svc, name_link);
+	if (svc->indexed & SVC_IDX_PIDFILE)
+		TAILQ_REMOVE(&pidfile_idx[SVC_BUCKET(svc->pidfile_hash)], svc, pidfile_link);
+	svc->indexed = 0;
+}
+
+/*
+ * Find, or create, interned copy of @len bytes at @buf, which includes
+ * the trailing NUL.  Returns pointer to interned data, or %NULL.
+ */
+static char *str_get(const char *buf, size_t len)
+{
+	unsigned int hash;
+	struct str *str;
+
+	if (len <= 1 && !buf[0])
+		return str_empty;
+
+	index_init();
+	hash = memhash(buf, len);
+	TAILQ_FOREACH(str, &str_idx[SVC_BUCKET(hash)], link) {
+		if (str->hash == hash && str->len == len && !memcmp(str->data, buf, len)) {
+			str->refcnt++;
+			return str->data;
+		}
+	}
+
+	str = malloc(sizeof(*str) + len);
+	if (!str)
+		return NULL;
+
+	str->hash   = hash;
+	str->refcnt = 1;
+	str->len    = len;
+	memcpy(str->data, buf, len);
+	TAILQ_INSERT_TAIL(&str_idx[SVC_BUCKET(hash)], str, link);
+
+	return str->data;
+}
+
+/* Take another reference to interned @data */
+static char *str_ref(const char *data)
+{
+	struct str *str;
+
+	if (!data || data == str_empty)
+		return str_empty;
+
+	str = (struct str *)(data - offsetof(struct str, data));
+	str->refcnt++;
+
+	return str->data;
+}
+
+/* Drop reference to interned @data, free when last user is gone */
+static void str_put(const char *data)
+{
+	struct str *str;
+
+	if (!data || data == str_empty)
+		return;
+
+	str = (struct str *)(data - offsetof(struct str, data));
+	if (--str->refcnt > 0)
+		return;
+
+	TAILQ_REMOVE(&str_idx[SVC_BUCKET(str->hash)], str, link);
+	free(str);
+}
+
+/**
+ * svc_strset - Set interned string member of a service
+ * @str: Pointer to string member, e.g. &svc->desc
+ * @val: New value, %NULL is the same as ""
+ *
+ * Releases the previous value of @str, which is never %NULL after this
+ * call, not even on failure.  It is safe to use a string member of any
+ * service as @val.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on failure to allocate memory.
+ */
+int svc_strset(char **str, const char *val)
+{
+	char *ptr;
+
+	if (!val)
+		val = "";
+
+	ptr = str_get(val, strlen(val) + 1);
+	if (!ptr) {
+		if (!*str)
+			*str = str_empty;
+		return errno = ENOMEM;
+	}
+
+	str_put(*str);
+	*str = ptr;
+
+	return 0;
+}
+
+/**
+ * svc_argset - Set command line arguments of a service
+ * @svc:  Pointer to an &svc_t object
+ * @argv: Arguments, argv[0] is the command
+ * @argc: Number of arguments in @argv
+ *
+ * The arguments are packed and interned, so there is no limit on the
+ * number or length of arguments.  Use svc_foreach_arg() to iterate.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on failure to allocate memory.
+ */
+int svc_argset(svc_t *svc, char *argv[], int argc)
+{
+	size_t len = 1;
+	char *buf, *ptr;
+	int i;
+
+	for (i = 0; i < argc; i++)
+		len += strlen(argv[i]) + 1;
+
+	buf = malloc(len);
+	if (!buf)
+		return errno = ENOMEM;
+
+	for (ptr = buf, i = 0; i < argc; i++)
+		ptr = stpcpy(ptr, argv[i]) + 1;
+	*ptr = 0;
+
+	ptr = str_get(buf, len);
+	free(buf);
+	if (!ptr)
+		return errno = ENOMEM;
+
+	str_put(svc->args);
+	svc->args = ptr;
+
+	return 0;
+}
+
+/**
+ * svc_argcopy - Copy command line arguments from one service to another
+ * @dst: Pointer to an &svc_t object
+ * @src: Pointer to an &svc_t object
+ *
+ * Returns:
+ * Always POSIX OK(0), the args are interned so only a reference is taken.
+ */
+int svc_argcopy(svc_t *dst, svc_t *src)
+{
+	char *args;
+
+	args = str_ref(src->args);
+	str_put(dst->args);
+	dst->args = args;
+
+	return 0;
+}
+
+/**
+ * svc_set_rlimit - Set resource limits of a service
+ * @svc:    Pointer to an &svc_t object
+ * @rlimit: Array of %RLIMIT_NLIMITS limits, copied, or %NULL to unset
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on failure to allocate memory.
+ */
+int svc_set_rlimit(svc_t *svc, const struct rlimit rlimit[])
+{
+	char *ptr = NULL;
+
+	if (rlimit)
+		ptr = str_get((const char *)rlimit, sizeof(struct rlimit) * RLIMIT_NLIMITS);
+	if (rlimit && !ptr)
+		return errno = ENOMEM;
+
+	str_put((const char *)svc->rlimit);
+	svc->rlimit = (const struct rlimit *)ptr;
+
+	return 0;
+}
 
 static void svc_gc(void *arg)
 {
@@ -61,7 +349,7 @@ static void svc_gc(void *arg)
 
 		TAILQ_REMOVE(&gc_list, svc, link);
 		cond_clear(mkcond(cond, sizeof(cond), svc->cmd));
-		free(svc);
+		svc_free(svc);
 	}
 
 	if (!TAILQ_EMPTY(&gc_list))
@@ -80,10 +368,12 @@ static void svc_gc(void *arg)
 svc_t *svc_new(char *cmd, char *id, int type)
 {
 	int job = -1;
-	svc_t *svc, *iter = NULL;
+	svc_t *svc;
+
+	index_init();
 
 	/* Find first job n:o if registering multiple instances */
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+	TAILQ_FOREACH(svc, &cmd_idx[SVC_BUCKET(strhash(cmd))], cmd_link) {
 		if (!strcmp(svc->cmd, cmd)) {
 			job = svc->job;
 			break;
@@ -92,19 +382,29 @@ svc_t *svc_new(char *cmd, char *id, int type)
 	if (job == -1)
 		job = jobcounter++;
 
-	svc = calloc(1, sizeof(*svc));
+	svc = pool_alloc(type == SVC_TYPE_INETD_CONN ? &conn_pool : &svc_pool);
 	if (!svc)
 		return NULL;
 
 	svc->type = type;
 	svc->job  = job;
 	strlcpy(svc->id, id, sizeof(svc->id));
-	strlcpy(svc->cmd, cmd, sizeof(svc->cmd));
+	if (svc_strset(&svc->cmd, cmd)) {
+		pool_free(svc);
+		return NULL;
+	}
 
-	/* Default description, if missing */
-	strlcpy(svc->desc, svc->name, sizeof(svc->desc));
+	/* Remaining strings default to "", may be set later */
+	svc_strset(&svc->args, NULL);
+	svc_strset(&svc->name, NULL);
+	svc_strset(&svc->desc, NULL);
+	svc_strset(&svc->cond, NULL);
+	svc_strset(&svc->pidfile, NULL);
+	svc_strset(&svc->file, NULL);
+	svc_strset(&svc->log.file, NULL);
 
 	TAILQ_INSERT_TAIL(&svc_list, svc, link);
+	index_add(svc);
 
 	return svc;
 }
@@ -123,6 +423,13 @@ static struct wq work = {
  */
 int svc_del(svc_t *svc)
 {
+	cond_dep_del(svc);
+	index_del(svc);
+	if (svc->queued) {
+		TAILQ_REMOVE(&run_queue, svc, runq_link);
+		svc->queued = 0;
+		run_queue_len--;
+	}
 	TAILQ_REMOVE(&svc_list, svc, link);
 	TAILQ_INSERT_TAIL(&gc_list, svc, link);
 
@@ -132,6 +439,193 @@ int svc_del(svc_t *svc)
 	return 0;
 }
 
+/**
+ * svc_dup - Snapshot of a service
+ * @svc: Pointer to an &svc_t object
+ *
+ * Only for comparing definitions, e.g. with svc_differs(), the copy is
+ * not registered or indexed.  Interned strings are shared with @svc.
+ *
+ * Returns:
+ * A pointer to a new &svc_t object, free with svc_free(), or %NULL.
+ */
+svc_t *svc_dup(svc_t *svc)
+{
+	svc_t *copy;
+
+	copy = pool_alloc(&svc_pool);
+	if (!copy)
+		return NULL;
+
+	memcpy(copy, svc, sizeof(*copy));
+	memset(&copy->timer, 0, sizeof(copy->timer));
+	copy->conds     = NULL;
+	copy->num_conds = 0;
+	copy->cmd       = str_ref(svc->cmd);
+	copy->args      = str_ref(svc->args);
+	copy->name      = str_ref(svc->name);
+	copy->desc      = str_ref(svc->desc);
+	copy->cond      = str_ref(svc->cond);
+	copy->pidfile   = str_ref(svc->pidfile);
+	copy->file      = str_ref(svc->file);
+	copy->log.file  = str_ref(svc->log.file);
+	copy->log.ring  = NULL;
+	copy->pending   = 0;
+	if (svc->rlimit)
+		copy->rlimit = (const struct rlimit *)str_ref((const char *)svc->rlimit);
+
+	return copy;
+}
+
+/**
+ * svc_free - Release memory of a service
+ * @svc: Pointer to an &svc_t object, from svc_dup() or collected by gc
+ */
+void svc_free(svc_t *svc)
+{
+	if (!svc)
+		return;
+
+	tmo_stop(&svc->timer);
+	str_put(svc->cmd);
+	str_put(svc->args);
+	str_put(svc->name);
+	str_put(svc->desc);
+	str_put(svc->cond);
+	str_put(svc->pidfile);
+	str_put(svc->file);
+	str_put(svc->log.file);
+	str_put((const char *)svc->rlimit);
+	svclog_ring_put(svc->log.ring);
+	pool_free(svc);
+}
+
+/**
+ * svc_pool_stats - Get usage and recycle statistics of svc_t pools
+ * @st:  Array of &struct init_pool, for the API
+ * @num: Number of entries in @st
+ *
+ * Returns:
+ * Number of entries filled in.
+ */
+int svc_pool_stats(struct init_pool *st, int num)
+{
+	struct pool *pools[] = { &svc_pool, &conn_pool };
+	int i;
+
+	for (i = 0; i < num && i < (int)NELEMS(pools); i++)
+		pool_stats(pools[i], &st[i]);
+
+	return i;
+}
+
+/**
+ * svc_set_pid - Update PID of service, and the PID lookup index
+ * @svc: Pointer to an &svc_t object
+ * @pid: New PID, or zero when the process has been collected
+ */
+void svc_set_pid(svc_t *svc, pid_t pid)
+{
+	pid_t *ptr = (pid_t *)&svc->pid;
+
+	if (svc->pid == pid)
+		return;
+
+	if (svc->pid > 0)
+		TAILQ_REMOVE(&pid_idx[SVC_BUCKET(svc->pid)], svc, pid_link);
+
+	*ptr = pid;
+
+	if (svc->pid > 0)
+		TAILQ_INSERT_TAIL(&pid_idx[SVC_BUCKET(svc->pid)], svc, pid_link);
+}
+
+/**
+ * svc_rehash - Update lookup indexes after changing name or PID file
+ * @svc: Pointer to an &svc_t object
+ *
+ * The cmd:id and job indexes are set up by svc_new(), since those keys
+ * never change.  The name and PID file of a service may however change
+ * at runtime, e.g. on .conf reload, so this function must be called
+ * after updating any of @svc->name or @svc->pidfile.
+ */
+void svc_rehash(svc_t *svc)
+{
+	unsigned int hash;
+
+	hash = strhash(svc->name);
+	if (!(svc->indexed & SVC_IDX_NAME) || hash != svc->name_hash) {
+		if (svc->indexed & SVC_IDX_NAME)
+			TAILQ_REMOVE(&name_idx[SVC_BUCKET(svc->name_hash)], svc, name_link);
+
+		svc->name_hash = hash;
+		TAILQ_INSERT_TAIL(&name_idx[SVC_BUCKET(hash)], svc, name_link);
+		svc->indexed |= SVC_IDX_NAME;
+	}
+
+	/* Connections share PID file with their inetd service, skip */
+	if (svc_is_inetd_conn(svc))
+		return;
+
+	hash = strhash(pid_file(svc));
+	if (!(svc->indexed & SVC_IDX_PIDFILE) || hash != svc->pidfile_hash) {
+		if (svc->indexed & SVC_IDX_PIDFILE)
+			TAILQ_REMOVE(&pidfile_idx[SVC_BUCKET(svc->pidfile_hash)], svc, pidfile_link);
+
+		svc->pidfile_hash = hash;
+		TAILQ_INSERT_TAIL(&pidfile_idx[SVC_BUCKET(hash)], svc, pidfile_link);
+		svc->indexed |= SVC_IDX_PIDFILE;
+	}
+}
+
+/**
+ * svc_enqueue - Add service to run queue, unless already queued
+ * @svc: Pointer to an &svc_t object
+ *
+ * Returns:
+ * %TRUE(1) if @svc was added, %FALSE(0) if it was already queued.
+ */
+int svc_enqueue(svc_t *svc)
+{
+	if (svc->queued)
+		return 0;
+
+	svc->queued = 1;
+	TAILQ_INSERT_TAIL(&run_queue, svc, runq_link);
+	run_queue_len++;
+
+	return 1;
+}
+
+/**
+ * svc_dequeue - Remove first service from run queue
+ *
+ * Returns:
+ * An &svc_t pointer, or %NULL if the run queue is empty.
+ */
+svc_t *svc_dequeue(void)
+{
+	svc_t *svc;
+
+	svc = TAILQ_FIRST(&run_queue);
+	if (!svc)
+		return NULL;
+
+	TAILQ_REMOVE(&run_queue, svc, runq_link);
+	svc->queued = 0;
+	run_queue_len--;
+
+	return svc;
+}
+
+/**
+ * svc_queued - Number of services in run queue
+ */
+int svc_queued(void)
+{
+	return run_queue_len;
+}
+
 /**
  * svc_iterator - Naive iterator over all registered services.
  * @iter:  Iterator, must be a valid pointer
@@ -223,12 +717,24 @@ svc_t *svc_job_iterator(svc_t **iter, int first, int job)
 {
 	svc_t *svc;
 
-	for (svc = svc_iterator(iter, first); svc; svc = svc_iterator(iter, 0)) {
-		if (svc->job == job)
-			return svc;
+	if (!iter) {
+		errno = EINVAL;
+		return NULL;
 	}
 
-	return NULL;
+	index_init();
+	if (first)
+		svc = TAILQ_FIRST(&job_idx[SVC_BUCKET(job)]);
+	else
+		svc = *iter;
+
+	while (svc && svc->job != job)
+		svc = TAILQ_NEXT(svc, job_link);
+
+	if (svc)
+		*iter = TAILQ_NEXT(svc, job_link);
+
+	return svc;
 }
 
 
@@ -291,15 +797,17 @@ svc_t *svc_stop_completed(void)
 /**
  * svc_find - Find a service object by its full path name
  * @cmd: Full path name, e.g., /sbin/syslogd
+ * @id:  Instance id
  *
  * Returns:
  * A pointer to an &svc_t object, or %NULL if not found.
  */
 svc_t *svc_find(char *cmd, char *id)
 {
-	svc_t *svc, *iter = NULL;
+	svc_t *svc;
 
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+	index_init();
+	TAILQ_FOREACH(svc, &cmd_idx[SVC_BUCKET(strhash(cmd))], cmd_link) {
 		if (!strcmp(svc->cmd, cmd) && !strcmp(svc->id, id))
 			return svc;
 	}
@@ -312,13 +820,18 @@ svc_t *svc_find(char *cmd, char *id)
  * @pid: Process ID to match
  *
  * Returns:
- * A pointer to an &svc_t object, or %NULL if not found.
+ * A pointer to an &svc_t object, or %NULL if not found.  Services
+ * that are not running, i.e. PID zero, are never matched.
  */
 svc_t *svc_find_by_pid(pid_t pid)
 {
-	svc_t *svc, *iter = NULL;
+	svc_t *svc;
 
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+	if (pid <= 0)
+		return NULL;
+
+	index_init();
+	TAILQ_FOREACH(svc, &pid_idx[SVC_BUCKET(pid)], pid_link) {
 		if (svc->pid == pid)
 			return svc;
 	}
@@ -336,9 +849,10 @@ svc_t *svc_find_by_pid(pid_t pid)
  */
 svc_t *svc_find_by_jobid(int job, char *id)
 {
-	svc_t *svc, *iter = NULL;
+	svc_t *svc;
 
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+	index_init();
+	TAILQ_FOREACH(svc, &job_idx[SVC_BUCKET(job)], job_link) {
 		if (svc->job == job && !strcmp(svc->id, id))
 			return svc;
 	}
@@ -356,9 +870,10 @@ svc_t *svc_find_by_jobid(int job, char *id)
  */
 svc_t *svc_find_by_nameid(char *name, char *id)
 {
-	svc_t *svc, *iter = NULL;
+	svc_t *svc;
 
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+	index_init();
+	TAILQ_FOREACH(svc, &name_idx[SVC_BUCKET(strhash(name))], name_link) {
 		if (!strcmp(svc->id, id) && !strcmp(name, svc->name))
 			return svc;
 	}
@@ -375,12 +890,13 @@ svc_t *svc_find_by_nameid(char *name, char *id)
  */
 svc_t *svc_find_by_pidfile(char *fn)
 {
-	svc_t *svc, *iter = NULL;
-
-	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
-		char path[MAX_ARG_LEN];
+	char path[MAX_ARG_LEN];
+	svc_t *svc;
 
-		if (string_compare(pid_runpath(fn, path, sizeof(path)), pid_file(svc)))
+	index_init();
+	pid_runpath(fn, path, sizeof(path));
+	TAILQ_FOREACH(svc, &pidfile_idx[SVC_BUCKET(strhash(path))], pidfile_link) {
+		if (string_compare(path, pid_file(svc)))
 			return svc;
 	}
 
@@ -411,6 +927,65 @@ void svc_mark_dynamic(void)
 	}
 }
 
+/**
+ * svc_mark_file - Mark services loaded from a .conf file for deletion.
+ * @name: Base name of .conf file in /etc/finit.d/
+ *
+ * Like svc_mark_dynamic(), but only for services loaded from @name, in
+ * either of /etc/finit.d/ or /etc/finit.d/enabled/.  Used on reload to
+ * re-parse only changed files.
+ */
+void svc_mark_file(char *name)
+{
+	svc_t *svc, *iter = NULL;
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		char *ptr;
+
+		if (svc->protect)
+			continue;
+		if (svc_is_inetd_conn(svc))
+			continue;
+
+		ptr = strrchr(svc->file, '/');
+		if (!string_compare(ptr ? ptr + 1 : svc->file, name))
+			continue;
+
+		*((int *)&svc->dirty) = -1;
+	}
+}
+
+/**
+ * svc_differs - Compare effective definition of two services
+ * @a: Pointer to an &svc_t object
+ * @b: Pointer to an &svc_t object, e.g. a snapshot of @a before reload
+ *
+ * Compares only what is used to start the service.  Changes to, e.g.,
+ * the description or runlevels do not require a restart, and conditions
+ * are compared when parsing, see conf_parse_cond().
+ *
+ * Returns:
+ * %TRUE(1) if the services differ, otherwise %FALSE(0).
+ */
+int svc_differs(svc_t *a, svc_t *b)
+{
+	/* Interned, so same content means same pointer */
+	if (a->args != b->args || a->rlimit != b->rlimit || a->pidfile != b->pidfile)
+		return 1;
+	if (strcmp(a->username, b->username) || strcmp(a->group, b->group))
+		return 1;
+	if (a->log.enabled != b->log.enabled || a->log.null != b->log.null ||
+	    a->log.console != b->log.console || a->log.file != b->log.file ||
+	    a->log.sync != b->log.sync || a->log.rate != b->log.rate ||
+	    a->log.bytes != b->log.bytes ||
+	    strcmp(a->log.prio, b->log.prio) || strcmp(a->log.ident, b->log.ident))
+		return 1;
+	if (a->sighup != b->sighup || a->shell != b->shell)
+		return 1;
+
+	return 0;
+}
+
 void svc_mark_dirty(svc_t *svc)
 {
 	*((int *)&svc->dirty) = 1;
@@ -448,7 +1023,7 @@ void svc_clean_dynamic(void (*cb)(svc_t *))
 int svc_clean_bootstrap(svc_t *svc)
 {
 	if (!ISOTHER(svc->runlevels, 0)) {
-		svc->pid = 0;
+		svc_set_pid(svc, 0);
 		svc_del(svc);
 		return 1;
 	}
@@ -33,6 +33,11 @@
 
 #include "inetd.h"
 #include "helpers.h"
+#include "tmo.h"
+
+struct cond_ref;
+struct init_pool;
+struct svclog_ring;
 
 typedef int svc_cmd_t;
 
@@ -68,11 +73,9 @@ typedef enum {
 
 #define MAX_ID_LEN       16
 #define MAX_ARG_LEN      64
-#define MAX_STR_LEN      64
 #define MAX_COND_LEN     (MAX_ARG_LEN * 3)
 #define MAX_USER_LEN     16
 #define MAX_NUM_FDS      64	     /* Max number of I/O plugins */
-#define MAX_NUM_SVC_ARGS 32
 
 /* Time after SIGTERM that we SIGKILL stopping processes */
 #define SVC_TERM_TIMEOUT 3000
@@ -86,69 +89,105 @@ typedef enum {
 typedef struct svc {
 	TAILQ_ENTRY(svc) link;
 
-	/* Instance specifics */
-	int            job;	       /* JOB: */
-	char           id[MAX_ID_LEN]; /* :ID */
-
-	/* Limits and scoping */
-	struct rlimit  rlimit[RLIMIT_NLIMITS];
-
-	/* Service details */
-	pid_t	       pid;
-	char           pidfile[256];
-	long           start_time;     /* Start time, as seconds since boot, from sysinfo() */
+	/* Run-time state, what service_step() needs, keep together */
 	const svc_state_t state;       /* Paused, Reloading, Restart, Running, ... */
 	svc_type_t     type;	       /* Service, run, task, inetd, ... */
-	int            protect;        /* Services like dbus-daemon & udev by Finit */
+	svc_block_t    block;	       /* Reason that this service is currently stopped */
+	const pid_t    pid;	       /* Use svc_set_pid() to keep lookup index in sync */
 	const int      dirty;	       /* -1: removal, 0: unmodified, 1: modified */
-	int            starting;       /* ... waiting for pidfile to be re-asserted */
 	int	       runlevels;
+	int            starting;       /* ... waiting for pidfile to be re-asserted */
 	int            sighup;	       /* This service supports SIGHUP :) */
-	svc_block_t    block;	       /* Reason that this service is currently stopped */
-	char           cond[MAX_COND_LEN];
-	char           name[MAX_ARG_LEN];
-
-	/* Counters */
+	int            protect;        /* Services like dbus-daemon & udev by Finit */
 	char           once;	       /* run/task, (at least) once per runlevel */
+	char           shell;	       /* run/task needs sh -c, or shell:yes */
+	char           pending;	       /* run/task bootstrap waits for */
 	const char     restart_cnt;    /* Incremented for each restart by service monitor. */
+	long           start_time;     /* Start time, as seconds since boot, from sysinfo() */
+	struct cond_ref **conds;       /* Compiled by cond_dep_add() */
+	int            num_conds;
 
-	/* For inetd services */
-	inetd_t        inetd;
-	int            stdin_fd;
-	char           iifname[IF_NAMESIZE + 1]; /* Ingress interface for connection */
+	/*
+	 * Used to forcefully kill services that won't shutdown on
+	 * termination and to delay restarts of crashing services.
+	 */
+	struct tmo     timer;
+	void           (*timer_cb)(struct svc *svc);
+
+	/* Instance specifics */
+	int            job;	       /* JOB: */
+	char           id[MAX_ID_LEN]; /* :ID */
+
+	/*
+	 * Command, arguments, and other strings are interned, i.e., shared
+	 * and reference counted, see svc_strset().  Never modify in place.
+	 */
+	char          *cmd;
+	char          *args;	       /* argv[], packed "arg0\0arg1\0...\0\0" */
+	char          *name;
+	char          *desc;
+	char          *cond;	       /* For initctl, see conds[] */
+	char          *pidfile;
+	char          *file;	       /* .conf file service was loaded from */
+
+	/* Limits and scoping, interned, see svc_set_rlimit() */
+	const struct rlimit *rlimit;
+
+	/* Identity */
+	char	       username[MAX_USER_LEN];
+	char	       group[MAX_USER_LEN];
 
 	/* Set for services we need to redirect stdout/stderr to syslog */
 	struct {
 		char   enabled;
 		char   null;
 		char   console;
-		char   file[64];
+		char  *file;	       /* Interned */
+		int    sync;	       /* msec, file only */
+		int    rate;	       /* Max lines/sec, 0: unlimited */
+		int    bytes;	       /* Max bytes/sec, 0: unlimited */
+		unsigned int dropped;  /* Lines over rate, for initctl */
 		char   prio[20];
 		char   ident[20];
+		struct svclog_ring *ring; /* Recent output, PID 1 only */
 	} log;
 
-	/* Identity */
-	char	       username[MAX_USER_LEN];
-	char	       group[MAX_USER_LEN];
-
-	/* Command, arguments and service description */
-	char	       cmd[MAX_ARG_LEN];
-	char	       args[MAX_NUM_SVC_ARGS][MAX_ARG_LEN];
-	char	       desc[MAX_STR_LEN];
-
-	/*
-	 * Used to forcefully kill services that won't shutdown on
-	 * termination and to delay restarts of crashing services.
-	 */
-	uev_t          timer;
-	void           (*timer_cb)(struct svc *svc);
+	/* For inetd services */
+	inetd_t        inetd;
+	int            stdin_fd;
+	char           iifname[IF_NAMESIZE + 1]; /* Ingress interface for connection */
 
 	/* time at svc_del(), used by gc timer */
 	struct timespec gc;
+
+	/* Lookup indexes, maintained by svc.c -- do not touch! */
+	TAILQ_ENTRY(svc) pid_link;
+	TAILQ_ENTRY(svc) cmd_link;
+	TAILQ_ENTRY(svc) job_link;
+	TAILQ_ENTRY(svc) name_link;
+	TAILQ_ENTRY(svc) pidfile_link;
+	unsigned int   name_hash;
+	unsigned int   pidfile_hash;
+	int            indexed;
+
+	/* Run queue, see service_enqueue() */
+	TAILQ_ENTRY(svc) runq_link;
+	int            queued;
 } svc_t;
 
 svc_t      *svc_new                (char *cmd, char *id, int type);
 int	    svc_del	           (svc_t *svc);
+svc_t      *svc_dup                (svc_t *svc);
+void        svc_free               (svc_t *svc);
+int         svc_pool_stats         (struct init_pool *st, int num);
+
+int         svc_strset             (char **str, const char *val);
+int         svc_argset             (svc_t *svc, char *argv[], int argc);
+int         svc_argcopy            (svc_t *dst, svc_t *src);
+int         svc_set_rlimit         (svc_t *svc, const struct rlimit rlimit[]);
+
+void        svc_set_pid            (svc_t *svc, pid_t pid);
+void        svc_rehash             (svc_t *svc);
 
 svc_t	   *svc_find	           (char *cmd, char *id);
 svc_t	   *svc_find_by_pid        (pid_t pid);
@@ -156,6 +195,10 @@ svc_t	   *svc_find_by_jobid      (int job, char *id);
 svc_t	   *svc_find_by_nameid     (char *name, char *id);
 svc_t      *svc_find_by_pidfile    (char *fn);
 
+int         svc_enqueue            (svc_t *svc);
+svc_t      *svc_dequeue            (void);
+int         svc_queued             (void);
+
 svc_t      *svc_iterator           (svc_t **iter, int first);
 svc_t      *svc_inetd_iterator     (svc_t **iter, int first);
 svc_t      *svc_named_iterator     (svc_t **iter, int first, char *cmd);
@@ -167,6 +210,8 @@ void        svc_foreach_type       (int types, int (*cb)(svc_t *));
 svc_t	   *svc_stop_completed	   (void);
 
 void	    svc_mark_dynamic       (void);
+void	    svc_mark_file          (char *name);
+int         svc_differs            (svc_t *a, svc_t *b);
 void	    svc_mark_dirty         (svc_t *svc);
 void	    svc_mark_clean         (svc_t *svc);
 void	    svc_clean_dynamic      (void (*cb)(svc_t *));
@@ -188,6 +233,39 @@ static inline int svc_in_runlevel  (svc_t *svc, int runlevel) { return svc && IS
 static inline int svc_has_sighup   (svc_t *svc) { return svc &&  0 != svc->sighup; }
 static inline int svc_has_pidfile  (svc_t *svc) { return svc_is_daemon(svc) && svc->pidfile[0] != 0 && svc->pidfile[0] != '!'; }
 
+/* Iterate over packed argv[] of a service, see svc_argset() */
+#define svc_foreach_arg(svc, arg) \
+	for (arg = (svc)->args; arg && *arg; arg += strlen(arg) + 1)
+
+/* Size of packed argv[], including the terminating empty string */
+static inline size_t svc_args_size(const char *args)
+{
+	const char *ptr = args;
+
+	while (*ptr)
+		ptr += strlen(ptr) + 1;
+
+	return ptr - args + 1;
+}
+
+/*
+ * String members of svc_t, used for the API wire format, where each
+ * pointer is replaced with an offset into a blob of strings sent after
+ * the svc_t.  See send_svc() in api.c and svc_read() in client.c
+ */
+#define SVC_NUM_STRINGS 8
+static inline void svc_strings(svc_t *svc, char **str[SVC_NUM_STRINGS])
+{
+	str[0] = &svc->args;	/* Packed argv[], must be first */
+	str[1] = &svc->cmd;
+	str[2] = &svc->name;
+	str[3] = &svc->desc;
+	str[4] = &svc->cond;
+	str[5] = &svc->pidfile;
+	str[6] = &svc->file;
+	str[7] = &svc->log.file;
+}
+
 static inline void svc_starting    (svc_t *svc) { if (svc) svc->starting = 1;       }
 static inline void svc_started     (svc_t *svc) { if (svc) svc->starting = 0;       }
 static inline int  svc_is_starting (svc_t *svc) { return svc && 0 != svc->starting; }
@@ -0,0 +1,704 @@
+/* Collector of service stdout/stderr, to syslog or log files
+ *
+ * Copyright (c) 2020  Joachim Nilsson <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#define SYSLOG_NAMES		/* facilitynames[] and prioritynames[] */
+#include <syslog.h>
+#include <fcntl.h>
+#include <paths.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <lite/lite.h>
+#include <lite/queue.h>		/* BSD sys/queue.h API */
+
+#include "finit.h"
+#include "conf.h"
+#include "helpers.h"
+#include "resolve.h"
+#include "svclog.h"
+#include "tmo.h"
+
+/*
+ * Instead of one logit process and pty per service, Finit reads the
+ * stdout/stderr of all services with `log` to syslog or a file from
+ * non-blocking pipes in the event loop.  Each line is sent to syslog
+ * with the service's tag and priority, or appended to its log file.
+ * Log files are shared by all services logging to them, and rotated
+ * by Finit according to the global `log size:N count:N` setting.
+ *
+ * Lines to a file are collected and written in one go when all pending
+ * input has been read, or the buffer is full.  Log files are only sync'ed
+ * to disk if a service asks for it with `log:/path,sync:MSEC`.
+ *
+ * The most recent lines of each service are also kept in a ring buffer,
+ * for `initctl status` and `initctl log`.  The ring is referenced by the
+ * svc_t, and by the pipe reader, so it survives restarts of the service.
+ *
+ * Optionally, `log:rate:LINES,bytes:BYTES` limits the lines and bytes
+ * per second a service can log, using token buckets with one second of
+ * burst.  Lines over the limit are dropped, and summarized in a single
+ * "N messages suppressed" line, after one second, or before the next
+ * line that is logged.
+ */
+#define SVCLOG_LINE_MAX 512
+#define SVCLOG_FILE_BUF 4096
+
+struct logfile {
+	TAILQ_ENTRY(logfile) link;
+	char        *name;
+	int          fd;
+	off_t        size;
+	int          refcnt;
+
+	int          sync;		/* msec, 0: never */
+	struct tmo   tmo;
+
+	size_t       len;		/* Pending lines in buf[] */
+	char         buf[SVCLOG_FILE_BUF];
+};
+
+struct svclog_ring {
+	int             refcnt;
+	unsigned int    dropped;	/* Total lines over rate limit */
+	uint32_t        head;		/* Total bytes written, wraps */
+	char            buf[SVCLOG_RING_SIZE];
+};
+
+struct bucket {
+	int             rate;		/* Per second, 0: unlimited */
+	int             tokens;
+	uint64_t        last;		/* msec, last refill */
+};
+
+struct svclog {
+	uev_t           watcher;
+	int             prio;		/* facility | level */
+	char            ident[32];
+	struct logfile *file;		/* NULL for syslog */
+	struct svclog_ring *ring;
+
+	struct bucket   lines;
+	struct bucket   bytes;
+	unsigned int    suppressed;	/* Since last summary */
+	struct tmo      tmo;
+
+	size_t          len;		/* Partial line in buf[] */
+	char            buf[SVCLOG_LINE_MAX];
+};
+
+static TAILQ_HEAD(, logfile) logfiles = TAILQ_HEAD_INITIALIZER(logfiles);
+static int log_sd = -1;
+
+
+/* Parse facility.level, or only level, like logger(1) */
+static int parse_prio(const char *arg)
+{
+	int facility = LOG_DAEMON, level = LOG_INFO;
+	char buf[20], *ptr;
+
+	if (!arg || !arg[0])
+		return facility | level;
+
+	strlcpy(buf, arg, sizeof(buf));
+	arg = buf;
+
+	ptr = strchr(buf, '.');
+	if (ptr) {
+		*ptr++ = 0;
+
+		for (int i = 0; facilitynames[i].c_name; i++) {
+			if (!strcmp(facilitynames[i].c_name, buf)) {
+				facility = facilitynames[i].c_val;
+				break;
+			}
+		}
+
+		arg = ptr;
+	}
+
+	for (int i = 0; prioritynames[i].c_name; i++) {
+		if (!strcmp(prioritynames[i].c_name, arg)) {
+			level = prioritynames[i].c_val;
+			break;
+		}
+	}
+
+	return facility | level;
+}
+
+static int file_reopen(struct logfile *lf, mode_t mode)
+{
+	struct stat st;
+
+	if (lf->fd >= 0) {
+		if (lf->sync)
+			fsync(lf->fd);
+		close(lf->fd);
+	}
+
+	lf->fd = open(lf->name, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, mode);
+	if (lf->fd < 0) {
+		logit(LOG_ERR, "Failed opening %s: %s", lf->name, strerror(errno));
+		return 1;
+	}
+
+	lf->size = 0;
+	if (!fstat(lf->fd, &st))
+		lf->size = st.st_size;
+
+	return 0;
+}
+
+static struct logfile *file_open(const char *name, int sync)
+{
+	struct logfile *lf;
+
+	TAILQ_FOREACH(lf, &logfiles, link) {
+		if (!strcmp(lf->name, name)) {
+			/* Shared, the shortest sync interval wins */
+			if (sync > 0 && (!lf->sync || sync < lf->sync))
+				lf->sync = sync;
+			lf->refcnt++;
+			return lf;
+		}
+	}
+
+	lf = calloc(1, sizeof(*lf));
+	if (!lf)
+		return NULL;
+
+	lf->fd   = -1;
+	lf->sync = sync > 0 ? sync : 0;
+	lf->name = strdup(name);
+	if (!lf->name || file_reopen(lf, 0644)) {
+		free(lf->name);
+		free(lf);
+		return NULL;
+	}
+
+	lf->refcnt = 1;
+	TAILQ_INSERT_TAIL(&logfiles, lf, link);
+
+	return lf;
+}
+
+static void file_flush(struct logfile *lf);
+
+static void file_close(struct logfile *lf)
+{
+	if (!lf || --lf->refcnt > 0)
+		return;
+
+	file_flush(lf);
+	tmo_stop(&lf->tmo);
+	if (lf->sync && lf->fd >= 0)
+		fsync(lf->fd);
+
+	TAILQ_REMOVE(&logfiles, lf, link);
+	close(lf->fd);
+	free(lf->name);
+	free(lf);
+}
+
+/*
+ * Detached, not a run job, so never holds up run_wait() callers or a
+ * slot of run_limit().  Collected as an unknown PID by sigchld_cb().
+ */
+static void file_gzip(char *file)
+{
+	char *args[] = { "gzip", file, NULL };
+	struct spawn sp = {
+		.argv    = args,
+		.envp    = environ,
+		.uid     = -1,
+		.gid     = -1,
+		.fd      = { -1, -1, -1 },
+	};
+	int fd;
+
+	sp.path = resolve_path("gzip");
+	if (!sp.path)
+		return;
+
+	fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+	if (fd >= 0)
+		sp.fd[0] = sp.fd[1] = sp.fd[2] = fd;
+
+	if (exec_spawn(&sp) == -1)
+		_pe("Failed starting gzip %s", file);
+	else if (sp.err)
+		logit(LOG_ERR, "Failed starting gzip %s: %s", file, strerror(sp.err));
+
+	if (fd >= 0)
+		close(fd);
+}
+
+/*
+ * Rotate @lf when it grows beyond logfile_size_max.  At most
+ * logfile_count_max old versions are kept, .2 and older are gzipped,
+ * in the background, if gzip is available.
+ */
+static void file_rotate(struct logfile *lf)
+{
+	size_t len = strlen(lf->name) + 10 + 1;
+	char ofile[len], nfile[len];
+	struct stat st;
+	int cnt;
+
+	if (logfile_count_max <= 0) {
+		if (ftruncate(lf->fd, 0))
+			logit(LOG_ERR, "Failed truncating %s during logrotate: %s", lf->name, strerror(errno));
+		lf->size = 0;
+		return;
+	}
+
+	if (fstat(lf->fd, &st))
+		st.st_mode = 0644;
+
+	/* First age zipped log files */
+	for (cnt = logfile_count_max; cnt > 2; cnt--) {
+		snprintf(ofile, len, "%s.%d.gz", lf->name, cnt - 1);
+		snprintf(nfile, len, "%s.%d.gz", lf->name, cnt);
+
+		/* May fail because ofile doesn't exist yet, ignore. */
+		(void)rename(ofile, nfile);
+	}
+
+	for (cnt = logfile_count_max; cnt > 0; cnt--) {
+		snprintf(ofile, len, "%s.%d", lf->name, cnt - 1);
+		snprintf(nfile, len, "%s.%d", lf->name, cnt);
+
+		/* May fail because ofile doesn't exist yet, ignore. */
+		(void)rename(ofile, nfile);
+
+		if (cnt == 2 && !access(nfile, F_OK))
+			file_gzip(nfile);
+	}
+
+	if (rename(lf->name, nfile)) {
+		if (ftruncate(lf->fd, 0))
+			logit(LOG_ERR, "Failed truncating %s during logrotate: %s", lf->name, strerror(errno));
+		lf->size = 0;
+		return;
+	}
+
+	if (!file_reopen(lf, st.st_mode & 0777))
+		(void)fchown(lf->fd, st.st_uid, st.st_gid);
+}
+
+static void file_sync(void *arg)
+{
+	struct logfile *lf = arg;
+
+	if (lf->fd >= 0)
+		fsync(lf->fd);
+}
+
+/* Write all pending lines, the size is tracked from what is written */
+static void file_flush(struct logfile *lf)
+{
+	ssize_t num;
+
+	if (!lf->len)
+		return;
+
+	if (lf->fd < 0) {
+		lf->len = 0;
+		return;
+	}
+
+	num = write(lf->fd, lf->buf, lf->len);
+	if (num > 0)
+		lf->size += num;
+	lf->len = 0;
+
+	if (lf->sync && !tmo_pending(&lf->tmo))
+		tmo_start(&lf->tmo, lf->sync, file_sync, lf);
+
+	/* Pending lines are always written before rotating */
+	if (logfile_size_max > 0 && lf->size > logfile_size_max)
+		file_rotate(lf);
+}
+
+static void file_line(struct logfile *lf, char *line, size_t len)
+{
+	if (lf->len + len + 1 > sizeof(lf->buf))
+		file_flush(lf);
+
+	memcpy(&lf->buf[lf->len], line, len);
+	lf->len += len;
+	lf->buf[lf->len++] = '\n';
+}
+
+/*
+ * Same format as syslog(3), which cannot be used since it has only one
+ * tag.  Never blocks, lines are dropped if syslogd cannot keep up, or
+ * has not been started yet.
+ */
+static void syslog_line(struct svclog *log, char *line, size_t len)
+{
+	struct sockaddr_un sun = { .sun_family = AF_UNIX, .sun_path = _PATH_LOG };
+	char buf[SVCLOG_LINE_MAX + 64], ts[16];
+	struct tm tm;
+	time_t now;
+	int num;
+
+	now = time(NULL);
+	localtime_r(&now, &tm);
+	strftime(ts, sizeof(ts), "%b %e %H:%M:%S", &tm);
+
+	num = snprintf(buf, sizeof(buf), "<%d>%s %s: %.*s", log->prio, ts, log->ident, (int)len, line);
+	if (num >= (int)sizeof(buf))
+		num = sizeof(buf) - 1;
+
+	for (int retry = 0; retry < 2; retry++) {
+		if (log_sd < 0) {
+			log_sd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			if (log_sd < 0)
+				return;
+
+			if (connect(log_sd, (struct sockaddr *)&sun, sizeof(sun))) {
+				close(log_sd);
+				log_sd = -1;
+				return;
+			}
+		}
+
+		if (send(log_sd, buf, num, MSG_NOSIGNAL) >= 0 || errno == EAGAIN)
+			return;
+
+		/* syslogd restarted, reconnect */
+		close(log_sd);
+		log_sd = -1;
+	}
+}
+
+static void ring_write(struct svclog_ring *ring, char *ptr, size_t len)
+{
+	while (len > 0) {
+		size_t off = ring->head % sizeof(ring->buf);
+		size_t num = min(len, sizeof(ring->buf) - off);
+
+		memcpy(&ring->buf[off], ptr, num);
+		ring->head += num;
+		ptr += num;
+		len -= num;
+	}
+}
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void bucket_init(struct bucket *b, int rate)
+{
+	b->rate   = rate > 0 ? rate : 0;
+	b->tokens = b->rate;
+	b->last   = now_ms();
+}
+
+/*
+ * Refill, at most one second worth of tokens, then take @num.  A line
+ * longer than the byte rate passes when the bucket is full, emptying
+ * it, otherwise such a line could never be logged.
+ */
+static int bucket_take(struct bucket *b, uint64_t now, int num)
+{
+	uint64_t refill;
+
+	if (!b->rate)
+		return 1;
+
+	refill = (now - b->last) * b->rate / 1000;
+	if (refill > 0) {
+		b->tokens = min((uint64_t)b->rate, b->tokens + refill);
+		b->last  += refill * 1000 / b->rate;
+	}
+
+	if (b->tokens < num) {
+		if (b->tokens < b->rate)
+			return 0;
+		num = b->tokens;
+	}
+	b->tokens -= num;
+
+	return 1;
+}
+
+static void output(struct svclog *log, char *line, size_t len)
+{
+	ring_write(log->ring, line, len);
+	ring_write(log->ring, "\n", 1);
+
+	if (log->file)
+		file_line(log->file, line, len);
+	else
+		syslog_line(log, line, len);
+}
+
+static void summary(struct svclog *log)
+{
+	char buf[64];
+	int len;
+
+	if (!log->suppressed)
+		return;
+
+	len = snprintf(buf, sizeof(buf), "%u messages suppressed", log->suppressed);
+	log->suppressed = 0;
+	output(log, buf, len);
+}
+
+/* At most one summary per second while flooding */
+static void summary_cb(void *arg)
+{
+	struct svclog *log = arg;
+
+	summary(log);
+	if (log->file)
+		file_flush(log->file);
+}
+
+static void svclog_line(struct svclog *log, char *line, size_t len)
+{
+	uint64_t now;
+
+	if (len && line[len - 1] == '\r')
+		len--;
+	if (!len)
+		return;
+
+	now = now_ms();
+	if (!bucket_take(&log->lines, now, 1) || !bucket_take(&log->bytes, now, len + 1)) {
+		if (!log->suppressed++)
+			tmo_start(&log->tmo, 1000, summary_cb, log);
+		log->ring->dropped++;
+		return;
+	}
+
+	summary(log);
+	output(log, line, len);
+}
+
+static void svclog_close(struct svclog *log)
+{
+	if (log->len)
+		svclog_line(log, log->buf, log->len);
+	tmo_stop(&log->tmo);
+	summary(log);
+
+	uev_io_stop(&log->watcher);
+	close(log->watcher.fd);
+	file_close(log->file);
+	svclog_ring_put(log->ring);
+	free(log);
+}
+
+static void svclog_cb(uev_t *w, void *arg, int events)
+{
+	struct svclog *log = arg;
+	int budget = 32;		/* Don't starve other events */
+	ssize_t num;
+	int err;
+
+	while ((num = read(w->fd, &log->buf[log->len], sizeof(log->buf) - log->len)) > 0) {
+		char *line = log->buf, *nl;
+		size_t len;
+
+		log->len += num;
+		while ((nl = memchr(line, '\n', log->len - (line - log->buf)))) {
+			svclog_line(log, line, nl - line);
+			line = nl + 1;
+		}
+
+		/* Keep partial line, unless too long for the buffer */
+		len = log->len - (line - log->buf);
+		if (len == sizeof(log->buf)) {
+			svclog_line(log, line, len);
+			len = 0;
+		}
+		memmove(log->buf, line, len);
+		log->len = len;
+
+		if (--budget == 0)
+			break;
+	}
+	err = errno;
+
+	/* All input read, or out of budget, write what we have */
+	if (log->file)
+		file_flush(log->file);
+
+	/* EOF, service and any children holding the pipe have exited */
+	if (!num || (num < 0 && err != EAGAIN && err != EINTR))
+		svclog_close(log);
+}
+
+/**
+ * svclog_open - set up collection of a service's stdout/stderr
+ * @svc: Service with log to syslog or file
+ *
+ * Returns:
+ * Write end of a pipe for the service's stdout and stderr, to be closed
+ * by the caller after starting the service, or -1 on error.
+ */
+int svclog_open(svc_t *svc)
+{
+	struct svclog *log;
+	int fd[2];
+
+	log = calloc(1, sizeof(*log));
+	if (!log)
+		return -1;
+
+	if (!svc->log.ring) {
+		svc->log.ring = calloc(1, sizeof(struct svclog_ring));
+		if (!svc->log.ring)
+			goto fail;
+		svc->log.ring->refcnt = 1;
+	}
+	log->ring = svc->log.ring;
+	log->ring->refcnt++;
+
+	if (svc->log.file[0] == '/') {
+		log->file = file_open(svc->log.file, svc->log.sync);
+		if (!log->file)
+			goto fail;
+	} else {
+		log->prio = parse_prio(svc->log.prio);
+		strlcpy(log->ident, svc->log.ident[0] ? svc->log.ident : basename(svc->cmd), sizeof(log->ident));
+	}
+	bucket_init(&log->lines, svc->log.rate);
+	bucket_init(&log->bytes, svc->log.bytes);
+
+	if (pipe2(fd, O_CLOEXEC))
+		goto fail;
+	fcntl(fd[0], F_SETFL, O_NONBLOCK);
+
+	if (uev_io_init(ctx, &log->watcher, svclog_cb, log, fd[0], UEV_READ)) {
+		close(fd[0]);
+		close(fd[1]);
+		goto fail;
+	}
+
+	return fd[1];
+fail:
+	_pe("Failed setting up log of %s", svc->cmd);
+	file_close(log->file);
+	svclog_ring_put(log->ring);
+	free(log);
+
+	return -1;
+}
+
+/**
+ * svclog_tail - read recent output of a service
+ * @svc: Service with log
+ * @pos: Position to read from, 0 for all, updated to current position
+ * @buf: Buffer for output, whole lines
+ * @len: Size of @buf, at least %SVCLOG_RING_SIZE to get all
+ *
+ * Lines that have been overwritten since @pos are skipped, as is a line
+ * that no longer is complete in the ring.  Useful for following output
+ * by calling again with the updated @pos.
+ *
+ * Returns:
+ * Number of bytes in @buf, or -1 if the service has no output captured.
+ */
+ssize_t svclog_tail(svc_t *svc, uint32_t *pos, char *buf, size_t len)
+{
+	struct svclog_ring *ring = svc->log.ring;
+	size_t num, off, part;
+	int partial = 0;
+	char *nl;
+
+	if (!ring)
+		return -1;
+
+	num = ring->head - *pos;
+	if (num > min(len, sizeof(ring->buf))) {
+		num = min(len, sizeof(ring->buf));
+		partial = 1;
+	}
+	*pos = ring->head;
+
+	off  = (ring->head - num) % sizeof(ring->buf);
+	part = min(num, sizeof(ring->buf) - off);
+	memcpy(buf, &ring->buf[off], part);
+	memcpy(&buf[part], ring->buf, num - part);
+
+	/* Skip what is left of an overwritten line */
+	if (partial) {
+		nl = memchr(buf, '\n', num);
+		if (!nl)
+			return 0;
+
+		off = nl - buf + 1;
+		memmove(buf, &buf[off], num - off);
+		num -= off;
+	}
+
+	return num;
+}
+
+/**
+ * svclog_dropped - lines dropped by the log rate limit of a service
+ * @svc: Service with log
+ *
+ * Returns:
+ * Total number of lines dropped, since Finit started collecting output.
+ */
+unsigned int svclog_dropped(svc_t *svc)
+{
+	if (!svc->log.ring)
+		return 0;
+
+	return svc->log.ring->dropped;
+}
+
+/**
+ * svclog_ring_put - release a reference to a ring buffer
+ * @ring: Ring buffer of svc_t, may be %NULL
+ */
+void svclog_ring_put(struct svclog_ring *ring)
+{
+	if (ring && --ring->refcnt <= 0)
+		free(ring);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,301 @@
+/* Timer wheel, all timeouts on a single timerfd
+ *
+ * Copyright (c) 2020  Joachim Nilsson <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "finit.h"
+#include "helpers.h"
+#include "tmo.h"
+
+/*
+ * Hierarchical timer wheel, with 1 msec resolution, like the classic
+ * Linux timer wheel.  The first level has one slot per msec, the next
+ * levels are cascaded into the first as time passes.  Starting and
+ * stopping a timeout is O(1) and does not cost a system call, unless
+ * the new timeout expires before the single timerfd is set to fire.
+ *
+ * Timeouts beyond the range of the wheel, ~18 hours, are clamped.
+ */
+#define TVR_BITS   8
+#define TVN_BITS   6
+#define TVR_SIZE   (1 << TVR_BITS)
+#define TVN_SIZE   (1 << TVN_BITS)
+#define TVR_MASK   (TVR_SIZE - 1)
+#define TVN_MASK   (TVN_SIZE - 1)
+#define TVN_LEVELS 3
+#define TMO_MAX    ((1ULL << (TVR_BITS + TVN_LEVELS * TVN_BITS)) - 1)
+
+#define INDEX(n)   ((wheel_time >> (TVR_BITS + (n) * TVN_BITS)) & TVN_MASK)
+
+static struct tmo_head tv1[TVR_SIZE];
+static struct tmo_head tvn[TVN_LEVELS][TVN_SIZE];
+static struct tmo_head due = TAILQ_HEAD_INITIALIZER(due);
+
+static uint64_t wheel_time;	/* Next msec to process */
+static uint64_t armed;		/* Deadline timerfd is set to, or 0 */
+static int      running;	/* Set while running callbacks */
+static int      pending;	/* Number of pending timeouts */
+static int      tfd = -1;
+static uev_t    watcher;
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void arm(uint64_t deadline)
+{
+	struct itimerspec it = { 0 };
+
+	if (deadline == armed)
+		return;
+
+	armed = deadline;
+	if (deadline) {
+		it.it_value.tv_sec  = deadline / 1000;
+		it.it_value.tv_nsec = (deadline % 1000) * 1000000;
+	}
+
+	if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &it, NULL))
+		_pe("Failed setting timerfd");
+}
+
+/* Insert in wheel, or on the due list if already expired */
+static void wheel_add(struct tmo *tmo)
+{
+	uint64_t expires = tmo->expires;
+	uint64_t idx;
+
+	if (expires < wheel_time) {
+		tmo->head = &due;
+	} else {
+		idx = expires - wheel_time;
+		if (idx < TVR_SIZE) {
+			tmo->head = &tv1[expires & TVR_MASK];
+		} else {
+			int n;
+
+			if (idx > TMO_MAX)
+				expires = wheel_time + TMO_MAX;
+
+			for (n = 0; n < TVN_LEVELS - 1; n++) {
+				if (idx < 1ULL << (TVR_BITS + (n + 1) * TVN_BITS))
+					break;
+			}
+			tmo->head = &tvn[n][(expires >> (TVR_BITS + n * TVN_BITS)) & TVN_MASK];
+		}
+	}
+
+	TAILQ_INSERT_TAIL(tmo->head, tmo, link);
+}
+
+static int cascade(int n, int index)
+{
+	struct tmo_head *head = &tvn[n][index];
+	struct tmo *tmo;
+
+	while ((tmo = TAILQ_FIRST(head))) {
+		TAILQ_REMOVE(head, tmo, link);
+		wheel_add(tmo);
+	}
+
+	return index;
+}
+
+static void expire(struct tmo *tmo)
+{
+	TAILQ_REMOVE(tmo->head, tmo, link);
+	tmo->head = NULL;
+	pending--;
+
+	tmo->cb(tmo->arg);
+}
+
+/*
+ * Next time we need to wake up, either when the first timeout in the
+ * first level expires, or when the next level is cascaded.
+ */
+static uint64_t wheel_next(void)
+{
+	uint64_t t, found = 0;
+	int i;
+
+	if (!pending)
+		return 0;
+	if (!TAILQ_EMPTY(&due))
+		return 1;	/* Long gone, fire at once */
+
+	for (i = 0; i < TVR_SIZE; i++) {
+		t = wheel_time + i;
+		if (!TAILQ_EMPTY(&tv1[t & TVR_MASK])) {
+			found = t;
+			break;
+		}
+	}
+
+	/* Walk level 0 wraps, where the second level is cascaded */
+	t = (wheel_time + TVR_MASK) & ~(uint64_t)TVR_MASK;
+	for (i = 0; i < TVN_SIZE; i++, t += TVR_SIZE) {
+		int idx = (t >> TVR_BITS) & TVN_MASK;
+
+		if (found && found <= t)
+			return found;
+		if (!idx || !TAILQ_EMPTY(&tvn[0][idx]))
+			return t;
+	}
+
+	return t;
+}
+
+static void tmo_run(uev_t *w, void *arg, int events)
+{
+	struct tmo *tmo;
+	uint64_t now, exp;
+	int num;
+
+	if (read(tfd, &exp, sizeof(exp)) != sizeof(exp) && errno != EAGAIN)
+		_pe("Failed reading timerfd");
+
+	armed = 0;
+	running = 1;
+
+	/* Only what is due now, callbacks may reschedule themselves */
+	num = 0;
+	TAILQ_FOREACH(tmo, &due, link)
+		num++;
+	while (num-- > 0 && !TAILQ_EMPTY(&due))
+		expire(TAILQ_FIRST(&due));
+
+	now = now_ms();
+	while (pending && wheel_time <= now) {
+		int index = wheel_time & TVR_MASK;
+
+		if (!index && !cascade(0, INDEX(0)) && !cascade(1, INDEX(1)))
+			cascade(2, INDEX(2));
+		wheel_time++;
+
+		while ((tmo = TAILQ_FIRST(&tv1[index])))
+			expire(tmo);
+	}
+	if (!pending)
+		wheel_time = now + 1;
+
+	running = 0;
+	arm(wheel_next());
+}
+
+/**
+ * tmo_init - Set up timer wheel and its timerfd
+ * @ctx: libuEv context, the main loop
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero on error.
+ */
+int tmo_init(uev_ctx_t *ctx)
+{
+	int i, n;
+
+	for (i = 0; i < TVR_SIZE; i++)
+		TAILQ_INIT(&tv1[i]);
+	for (n = 0; n < TVN_LEVELS; n++) {
+		for (i = 0; i < TVN_SIZE; i++)
+			TAILQ_INIT(&tvn[n][i]);
+	}
+	wheel_time = now_ms();
+
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (tfd < 0) {
+		_pe("Failed creating timerfd");
+		return 1;
+	}
+
+	return uev_io_init(ctx, &watcher, tmo_run, NULL, tfd, UEV_READ);
+}
+
+/**
+ * tmo_start - Start, or restart, a timeout
+ * @tmo:  Pointer to &struct tmo
+ * @msec: Timeout, in milliseconds, zero to run at next loop iteration
+ * @cb:   Callback when @msec has elapsed
+ * @arg:  Argument to @cb
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero on error.
+ */
+int tmo_start(struct tmo *tmo, int msec, void (*cb)(void *), void *arg)
+{
+	uint64_t now;
+
+	if (!tmo || !cb || msec < 0)
+		return errno = EINVAL;
+	if (tfd < 0)
+		return errno = EAGAIN;
+
+	tmo_stop(tmo);
+
+	now = now_ms();
+	if (!pending && !running)
+		wheel_time = now;
+
+	tmo->cb      = cb;
+	tmo->arg     = arg;
+	tmo->expires = now + msec;
+	wheel_add(tmo);
+	pending++;
+
+	if (!running && (!armed || tmo->expires < armed))
+		arm(tmo->head == &due ? 1 : tmo->expires);
+
+	return 0;
+}
+
+/**
+ * tmo_stop - Stop a pending timeout
+ * @tmo: Pointer to &struct tmo
+ *
+ * Does not touch the timerfd, if it was set to fire for @tmo we will
+ * simply find nothing to do and set it for the next timeout.
+ */
+void tmo_stop(struct tmo *tmo)
+{
+	if (!tmo_pending(tmo))
+		return;
+
+	TAILQ_REMOVE(tmo->head, tmo, link);
+	tmo->head = NULL;
+	pending--;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
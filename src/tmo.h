@@ -0,0 +1,59 @@
+/* Timer wheel, all timeouts on a single timerfd
+ *
+ * Copyright (c) 2020  Joachim Nilsson <troglobit@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_TMO_H_
+#define FINIT_TMO_H_
+
+#include <stdint.h>
+#include <lite/queue.h>		/* BSD sys/queue.h API */
+#include <uev/uev.h>
+
+struct tmo;
+TAILQ_HEAD(tmo_head, tmo);
+
+/*
+ * A timeout, embed in the object it concerns and start with
+ * tmo_start().  Zero initialized means not pending.
+ */
+struct tmo {
+	TAILQ_ENTRY(tmo) link;
+	struct tmo_head *head;		/* Slot when pending, or NULL */
+	uint64_t         expires;	/* msec, CLOCK_MONOTONIC */
+	void           (*cb)(void *arg);
+	void            *arg;
+};
+
+int  tmo_init    (uev_ctx_t *ctx);
+int  tmo_start   (struct tmo *tmo, int msec, void (*cb)(void *), void *arg);
+void tmo_stop    (struct tmo *tmo);
+
+static inline int tmo_pending(struct tmo *tmo) { return tmo && tmo->head != NULL; }
+
+#endif /* FINIT_TMO_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -78,6 +78,20 @@ void tty_mark(void)
 		tty->dirty = -1;
 }
 
+/* Mark TTYs loaded from .conf file @name for removal */
+void tty_mark_file(char *name)
+{
+	struct tty *tty;
+
+	LIST_FOREACH(tty, &tty_list, link) {
+		char *ptr;
+
+		ptr = strrchr(tty->file, '/');
+		if (string_compare(ptr ? ptr + 1 : tty->file, name))
+			tty->dirty = -1;
+	}
+}
+
 void tty_sweep(void)
 {
 	struct tty *tty, *tmp;
@@ -278,6 +292,7 @@ again:
 
 	/* Register configured limits */
 	memcpy(entry->rlimit, rlimit, sizeof(entry->rlimit));
+	strlcpy(entry->file, file ? file : "", sizeof(entry->file));
 
 	if (file && conf_changed(file))
 		entry->dirty = 1; /* Modified, restart */
@@ -53,9 +53,13 @@ struct tty {
 
 	/* Set if modified => reloaded, or -1 when marked for removal */
 	int    dirty;
+
+	/* .conf file TTY was loaded from, empty for finit.conf */
+	char   file[256];
 };
 
 void	    tty_mark	    (void);
+void	    tty_mark_file   (char *name);
 void	    tty_sweep	    (void);
 
 int	    tty_register    (char *line, struct rlimit rlimit[], char *file);